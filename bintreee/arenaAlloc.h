@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+/*
+Bump pointer arena. Allocating is a pointer increment, deallocate only takes back the most recent allocation.
+Everything else stays until reset() or until the arena dies.
+Meant for build-and-discard trees: bintree::clear() resets the arena instead of visiting every element when Type is trivially destructible.
+*/
+template<class Type>
+class arenaAllocator {
+    using Pointer = Type*;
+    struct alignas(Type) slot {
+        char bytes[sizeof(Type)];
+    };
+    static const size_t firstChunkSlots = 1024;
+    static const size_t maxChunkSlots = 1u << 20; //chunks double until this size
+
+    struct chunk {
+        std::unique_ptr<slot[]> data;
+        size_t size;
+    };
+    std::vector<chunk> chunks;
+    slot* cur = nullptr;
+    slot* end = nullptr;
+    size_t nextChunkSlots = firstChunkSlots;
+
+    void newChunk(size_t minSlots) {
+        auto size = std::max(nextChunkSlots, minSlots);
+        chunks.push_back({ std::unique_ptr<slot[]>(new slot[size]), size });
+        cur = chunks.back().data.get();
+        end = cur + size;
+        if (nextChunkSlots < maxChunkSlots) nextChunkSlots *= 2;
+    }
+
+public:
+    using value_type = Type;
+
+    arenaAllocator() = default;
+
+    Pointer allocate(const std::size_t count) {//O(1)
+        if (static_cast<size_t>(end - cur) < count)
+            newChunk(count);
+        auto ptr = cur;
+        cur += count;
+        return reinterpret_cast<Pointer>(ptr);
+    }
+
+    void deallocate(const Pointer ptr, const std::size_t count = 1) noexcept {//O(1). Only the last allocation is given back
+        if (reinterpret_cast<slot*>(ptr) + count == cur)
+            cur = reinterpret_cast<slot*>(ptr);
+    }
+
+    void reset() noexcept {//O(chunks). Forgets every allocation. Only the biggest chunk is kept for reuse
+        if (chunks.empty()) return;
+        if (chunks.size() > 1) {
+            std::swap(chunks.front(), chunks.back());
+            chunks.erase(chunks.begin() + 1, chunks.end());
+        }
+        cur = chunks.front().data.get();
+        end = cur + chunks.front().size;
+    }
+
+    size_t reservedBytes() const noexcept {
+        size_t bytes = 0;
+        for (auto& ch : chunks)
+            bytes += ch.size * sizeof(slot);
+        return bytes;
+    }
+};
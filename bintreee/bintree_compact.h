@@ -0,0 +1,326 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <new>
+
+/*
+compact binary tree
+parent/left/right are 32 bit indices into one slab owned by the tree instead of pointers. A uint32_t element is 16 bytes instead of 32.
+Growing the slab moves the elements but indices stay valid. Freed slots are chained into a freelist and reused first.
+Unbalanced, same shape as bintree with bintreeUnbalanced. At most 2^32 - 2 elements.
+*/
+
+template<class Type>
+class compactBintreeElement {
+public:
+    static const uint32_t none = ~uint32_t(0);
+
+    uint32_t parent{ none };
+    uint32_t leftEl{ none };
+    uint32_t rightEl{ none }; //next free slot while on the freelist
+    Type value;
+
+    explicit compactBintreeElement(uint32_t _parent, Type&& v) : parent(_parent), value(std::forward<Type>(v)) {}
+
+    explicit operator const Type&() const {
+        return value;
+    }
+
+    bool hasLeft() const noexcept { return leftEl != none; }
+    bool hasRight() const noexcept { return rightEl != none; }
+};
+
+template<class Type>
+class compactBintree {
+    using bintreeElement = compactBintreeElement<Type>;
+    static const uint32_t none = bintreeElement::none;
+
+    std::vector<bintreeElement> slab;
+    uint32_t freeSlot = none; //freelist through rightEl
+    uint32_t root = none;
+    uint32_t leftmost = none; //cached min and max element
+    uint32_t rightmost = none;
+    uint32_t elemCount = 0;
+
+    uint32_t alloc(uint32_t par, Type&& initV) {
+        if (freeSlot != none) {
+            auto index = freeSlot;
+            auto& el = slab[index];
+            freeSlot = el.rightEl;
+            el.parent = par;
+            el.leftEl = el.rightEl = none;
+            el.value = std::forward<Type>(initV);
+            return index;
+        }
+        if (slab.size() >= none) throw std::bad_alloc();
+        slab.emplace_back(par, std::forward<Type>(initV));
+        return static_cast<uint32_t>(slab.size() - 1);
+    }
+
+    void deAlloc(uint32_t index) {//The value stays in the slot until it is reused or the tree is cleared
+        auto& el = slab[index];
+        el.parent = el.leftEl = none;
+        el.rightEl = freeSlot;
+        freeSlot = index;
+    }
+
+    void replaceChild(uint32_t old, uint32_t with) {//Hangs 'with' into the slot of 'old' at old's parent
+        auto par = slab[old].parent;
+        if (with != none) slab[with].parent = par;
+        if (par == none) root = with;
+        else if (slab[par].leftEl == old) slab[par].leftEl = with;
+        else slab[par].rightEl = with;
+    }
+
+    uint32_t leftmostOf(uint32_t me) const noexcept {
+        while (slab[me].hasLeft())
+            me = slab[me].leftEl;
+        return me;
+    }
+
+    uint32_t rightmostOf(uint32_t me) const noexcept {
+        while (slab[me].hasRight())
+            me = slab[me].rightEl;
+        return me;
+    }
+
+    uint32_t next(uint32_t me) const noexcept {//in-order successor. none after the last element
+        if (slab[me].hasRight()) return leftmostOf(slab[me].rightEl);
+        auto par = slab[me].parent;
+        while (par != none && slab[par].rightEl == me) {
+            me = par;
+            par = slab[par].parent;
+        }
+        return par;
+    }
+
+    uint32_t previous(uint32_t me) const noexcept {//in-order predecessor. none before the first element
+        if (slab[me].hasLeft()) return rightmostOf(slab[me].leftEl);
+        auto par = slab[me].parent;
+        while (par != none && slab[par].leftEl == me) {
+            me = par;
+            par = slab[par].parent;
+        }
+        return par;
+    }
+
+    template <typename Func>
+    void walk(Func func) const {//O(N). func(index, level, step) for step 0 = coming down, 1 = back from left, 2 = back from right
+        uint32_t me = root;
+        uint32_t lastEl = none;
+        size_t level = 1;
+        while (me != none) {
+            auto& el = slab[me];
+            if (lastEl == el.parent) {
+                func(me, level, 0);
+                if (el.hasLeft()) {
+                    lastEl = me;
+                    me = el.leftEl;
+                    level++;
+                    continue;
+                }
+                lastEl = none;
+            }
+            if (lastEl == el.leftEl) {
+                func(me, level, 1);
+                if (el.hasRight()) {
+                    lastEl = me;
+                    me = el.rightEl;
+                    level++;
+                    continue;
+                }
+                lastEl = none;
+            }
+            if (lastEl == el.rightEl) {
+                func(me, level, 2);
+                lastEl = me;
+                me = el.parent;
+                level--;
+            }
+        }
+    }
+
+public:
+    compactBintree() = default;
+
+    class iterator : public std::iterator<std::bidirectional_iterator_tag, Type> {
+        uint32_t me = none;
+        const compactBintree* tree;
+    public:
+        explicit iterator(const compactBintree& bt, uint32_t st) : me(st), tree(&bt) {}
+
+        iterator& operator++() {
+            me = tree->next(me);
+            return *this;
+        } // prefix++
+        iterator  operator++(int) {
+            iterator tmp(*this);
+            me = tree->next(me);
+            return tmp;
+        } // postfix++
+        iterator& operator--() {
+            me = (me == none) ? tree->rightmost : tree->previous(me);
+            return *this;
+        } // prefix--
+        iterator  operator--(int) {
+            iterator tmp(*this);
+            --*this;
+            return tmp;
+        } // postfix--
+
+        bool operator==(const iterator& other) const { return me == other.me; }
+        bool operator!=(const iterator& other) const { return me != other.me; }
+
+        const Type& operator*() { return tree->slab[me].value; }
+        const Type* operator->() { return &tree->slab[me].value; }
+        explicit operator Type() const { return tree->slab[me].value; }
+    };
+
+    template <typename Func>
+    void inOrder(Func func) const { //O(N)
+        walk([&](uint32_t me, size_t, int step) {
+            if (step == 1) func(slab[me].value);
+        });
+    }
+
+    template <typename Func>
+    void preOrder(Func func) const { //O(N)
+        walk([&](uint32_t me, size_t, int step) {
+            if (step == 0) func(slab[me].value);
+        });
+    }
+
+    template <typename Func>
+    void postOrder(Func func) const { //O(N)
+        walk([&](uint32_t me, size_t, int step) {
+            if (step == 2) func(slab[me].value);
+        });
+    }
+
+    template <typename Func>
+    void inOrderBackwards(Func func) const { //O(N)
+        for (auto me = rightmost; me != none; me = previous(me))
+            func(slab[me].value);
+    }
+
+    size_t depth() const {//O(N) visits every element
+        size_t maxLevel = 0;
+        walk([&maxLevel](uint32_t, size_t level, int) {
+            maxLevel = std::max(level, maxLevel);
+        });
+        return maxLevel;
+    }
+
+    const Type& emplace(Type&& elem) {//O(N) on empty tree or worst case. O(log2 N) on balanced tree
+        if (root == none) {
+            leftmost = rightmost = root = alloc(none, std::forward<Type>(elem));
+            ++elemCount;
+            return slab[root].value;
+        }
+        auto me = root;
+        bool isLeftmost = true;
+        bool isRightmost = true;
+        while (true) {
+            if (elem < slab[me].value) {
+                isRightmost = false;
+                if (!slab[me].hasLeft()) {
+                    auto newEl = alloc(me, std::forward<Type>(elem)); //may grow the slab. Index me stays valid
+                    slab[me].leftEl = newEl;
+                    if (isLeftmost) leftmost = newEl;
+                    ++elemCount;
+                    return slab[newEl].value;
+                }
+                me = slab[me].leftEl;
+            } else {
+                isLeftmost = false;
+                if (!slab[me].hasRight()) {
+                    auto newEl = alloc(me, std::forward<Type>(elem));
+                    slab[me].rightEl = newEl;
+                    if (isRightmost) rightmost = newEl;
+                    ++elemCount;
+                    return slab[newEl].value;
+                }
+                me = slab[me].rightEl;
+            }
+        }
+    }
+
+    const Type& insert(Type elem) {//O(N) on empty tree or worst case. O(log2 N) on balanced tree
+        return emplace(std::forward<Type>(elem));
+    }
+
+    void remove(Type elem) {//O(depth) to find and unlink. Two sub elements are replaced by the in-order successor
+        auto me = root;
+        while (me != none && slab[me].value != elem)
+            me = (elem < slab[me].value) ? slab[me].leftEl : slab[me].rightEl;
+        if (me == none) return; //elem doesn't exist
+
+        if (me == leftmost) leftmost = next(me);
+        if (me == rightmost) rightmost = previous(me);
+        auto& el = slab[me];
+        if (!el.hasLeft()) {
+            replaceChild(me, el.rightEl);
+        } else if (!el.hasRight()) {
+            replaceChild(me, el.leftEl);
+        } else {//Two sub elements. Successor takes our place
+            auto succ = leftmostOf(el.rightEl);
+            if (succ != el.rightEl) {
+                replaceChild(succ, slab[succ].rightEl);
+                slab[succ].rightEl = el.rightEl;
+                slab[el.rightEl].parent = succ;
+            }
+            slab[succ].leftEl = el.leftEl;
+            slab[el.leftEl].parent = succ;
+            replaceChild(me, succ);
+        }
+        deAlloc(me);
+        --elemCount;
+    }
+
+    void clear() {//O(N) destroys the values. Keeps the slab capacity
+        slab.clear();
+        freeSlot = root = leftmost = rightmost = none;
+        elemCount = 0;
+    }
+    void reserve(size_t count) {
+        slab.reserve(count);
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount;
+    }
+    Type minValue() const {//O(1) cached. Type() on an empty tree
+        if (leftmost == none) return Type();
+        return slab[leftmost].value;
+    }
+    Type maxValue() const {//O(1) cached. Type() on an empty tree
+        if (rightmost == none) return Type();
+        return slab[rightmost].value;
+    }
+    bool contains(const Type& searchVal) const {//(log2 N) to O(N)
+        auto me = root;
+        while (me != none && slab[me].value != searchVal)
+            me = (searchVal < slab[me].value) ? slab[me].leftEl : slab[me].rightEl;
+        return me != none;
+    }
+
+    iterator begin() const {//O(1) starts at cached leftmost
+        return iterator(*this, leftmost);
+    }
+    iterator end() const {
+        return iterator(*this, none);
+    }
+    bool empty() const {
+        return root == none;
+    }
+    void swap(compactBintree& other) {
+        slab.swap(other.slab);
+        std::swap(freeSlot, other.freeSlot);
+        std::swap(root, other.root);
+        std::swap(leftmost, other.leftmost);
+        std::swap(rightmost, other.rightmost);
+        std::swap(elemCount, other.elemCount);
+    }
+};
@@ -0,0 +1,340 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+/*
+Epoch based reclamation. Process wide, shared by every concurrent tree.
+Readers pin the current epoch while they look at shared elements. Unlinked elements are retired with the epoch they were unlinked in
+and only freed once the global epoch moved two steps past that, by then no reader can still hold them.
+*/
+class epochReclamation {
+    struct readerRecord {
+        std::atomic<uint64_t> state{ 0 }; //(epoch << 1) | 1 while pinned, 0 otherwise
+        std::atomic<bool> inUse{ true };
+        readerRecord* next = nullptr;
+    };
+
+    static std::atomic<uint64_t>& globalEpoch() {
+        static std::atomic<uint64_t> epoch{ 1 };
+        return epoch;
+    }
+    static std::atomic<readerRecord*>& records() {//push only. Records of exited threads are reused
+        static std::atomic<readerRecord*> head{ nullptr };
+        return head;
+    }
+
+    struct threadRecord {
+        readerRecord* record = nullptr;
+        uint32_t pinDepth = 0;
+        threadRecord() {
+            for (auto rec = records().load(std::memory_order_acquire); rec; rec = rec->next) {
+                bool expected = false;
+                if (!rec->inUse.load(std::memory_order_relaxed) && rec->inUse.compare_exchange_strong(expected, true)) {
+                    record = rec;
+                    return;
+                }
+            }
+            record = new readerRecord(); //never deleted
+            record->next = records().load(std::memory_order_relaxed);
+            while (!records().compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed));
+        }
+        ~threadRecord() {
+            record->state.store(0, std::memory_order_release);
+            record->inUse.store(false, std::memory_order_release);
+        }
+    };
+    static threadRecord& thisThread() {
+        static thread_local threadRecord rec;
+        return rec;
+    }
+
+public:
+    class guard {//Keeps elements seen while it lives from being freed. Nests
+        threadRecord* rec;
+    public:
+        guard() : rec(&thisThread()) {
+            if (rec->pinDepth++) return;
+            rec->record->state.store((globalEpoch().load(std::memory_order_relaxed) << 1) | 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst); //pin has to be visible before we load any link
+        }
+        ~guard() {
+            if (--rec->pinDepth) return;
+            rec->record->state.store(0, std::memory_order_release);
+        }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+    };
+
+    static uint64_t currentEpoch() noexcept {
+        return globalEpoch().load(std::memory_order_acquire);
+    }
+
+    static uint64_t tryAdvance() noexcept {//Moves the epoch on if every pinned reader has seen the current one. Returns the epoch
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto epoch = globalEpoch().load(std::memory_order_acquire);
+        for (auto rec = records().load(std::memory_order_acquire); rec; rec = rec->next) {
+            auto state = rec->state.load(std::memory_order_acquire);
+            if ((state & 1) && (state >> 1) != epoch) return epoch;
+        }
+        globalEpoch().compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+        return globalEpoch().load(std::memory_order_acquire);
+    }
+
+    static bool isSafe(uint64_t retiredEpoch) noexcept {//Nobody can reach something that was retired in retiredEpoch anymore
+        return retiredEpoch + 2 <= currentEpoch();
+    }
+};
+
+/*
+concurrent binary tree
+Any number of readers run contains, find and the traversals without locks while writers (serialized by a mutex) insert and remove.
+Links are published with release stores. Removed elements are retired to epochReclamation instead of being freed right away.
+Two sub elements: a copy of the in-order successor replaces the removed element, the old successor is unlinked one grace period later,
+so a reader that is on its way to it still finds it (relativistic removal). Until then a traversal may report the moved value twice.
+Writers never wait for that grace period. Every writer unlinks the old successors whose grace period is over, right away if no reader
+is pinned, otherwise in a later insert or remove. If the successor
+is such an old successor itself, the removed element is only marked removed, readers skip it, and a later writer unlinks it.
+So a pinned thread may insert and remove too, e.g. from an inOrder or find callback.
+Unbalanced, there are no parent links. Readers see each change atomically, but a traversal may see some changes and not others.
+*/
+template<class Type>
+class concurrentBintreeElement {
+public:
+    std::atomic<concurrentBintreeElement*> leftEl{ nullptr };
+    std::atomic<concurrentBintreeElement*> rightEl{ nullptr };
+    std::atomic<bool> removed{ false }; //removed but still linked. Readers skip it
+    bool moved = false; //writer only. A copy took its place, unlinked once no reader can be headed to it
+    Type value;
+
+    explicit concurrentBintreeElement(Type&& v) : value(std::forward<Type>(v)) {}
+    explicit concurrentBintreeElement(const Type& v) : value(v) {}
+};
+
+template<class Type, class Alloc = std::allocator<concurrentBintreeElement<Type>>>
+class concurrentBintree {
+    using bintreeElement = concurrentBintreeElement<Type>;
+    using link = std::atomic<bintreeElement*>;
+    using nodeAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<bintreeElement>;
+    nodeAllocator allocator = nodeAllocator();
+    template<class Value>
+    bintreeElement* alloc(Value&& initV) {
+        auto newElem = allocator.allocate(1);
+        ::new(newElem) bintreeElement(std::forward<Value>(initV));
+        return newElem;
+    }
+    void deAlloc(bintreeElement* elem) {
+        elem->~bintreeElement();
+        allocator.deallocate(elem, 1);
+    }
+
+    link root{ nullptr };
+    std::atomic<uint64_t> elemCount{ 0 };
+    std::mutex writerLock;
+    std::vector<std::pair<bintreeElement*, uint64_t>> retired; //writer only. Element and epoch it was retired in
+    std::vector<bintreeElement*> tombstones; //writer only. Marked removed, still linked
+    std::vector<std::pair<bintreeElement*, uint64_t>> stale; //writer only. Moved successors and the epoch their copy was published in
+
+    static bintreeElement* read(const link& l) noexcept {//readers. Pairs with the release store that published the element
+        return l.load(std::memory_order_acquire);
+    }
+    static void publish(link& l, bintreeElement* el) noexcept {
+        l.store(el, std::memory_order_release);
+    }
+
+    void retire(bintreeElement* el) {
+        retired.emplace_back(el, epochReclamation::currentEpoch());
+        if (retired.size() % 64 == 0)
+            reclaim();
+    }
+    void reclaim() {//frees what no reader can see anymore
+        epochReclamation::tryAdvance();
+        size_t kept = 0;
+        for (auto& entry : retired) {
+            if (epochReclamation::isSafe(entry.second))
+                deAlloc(entry.first);
+            else
+                retired[kept++] = entry;
+        }
+        retired.resize(kept);
+    }
+
+    const bintreeElement* findElement(const Type& searchVal) const noexcept {//caller is pinned
+        auto me = read(root);
+        while (me && (me->value != searchVal || me->removed.load(std::memory_order_acquire)))
+            me = (searchVal < me->value) ? read(me->leftEl) : read(me->rightEl);
+        return me;
+    }
+
+    link* slotOf(const bintreeElement* el) noexcept {//writer. The link that points to el. Equal values are always to the right
+        link* slot = &root;
+        bintreeElement* me;
+        while ((me = slot->load(std::memory_order_relaxed)) != el)
+            slot = (el->value < me->value) ? &me->leftEl : &me->rightEl;
+        return slot;
+    }
+
+    bool unlink(link* slot, bintreeElement* me) {//writer. false if me has to wait, its successor is still linked twice
+        auto left = me->leftEl.load(std::memory_order_relaxed);
+        auto right = me->rightEl.load(std::memory_order_relaxed);
+        if (!left || !right) {
+            publish(*slot, left ? left : right);
+            retire(me);
+            return true;
+        }
+        auto succ = right;
+        while (auto next = succ->leftEl.load(std::memory_order_relaxed))
+            succ = next;
+        if (succ->moved) return false;
+        auto copy = alloc(succ->value);
+        copy->leftEl.store(left, std::memory_order_relaxed);
+        if (succ->removed.load(std::memory_order_relaxed)) {//the copy stays a tombstone
+            copy->removed.store(true, std::memory_order_relaxed);
+            std::replace(tombstones.begin(), tombstones.end(), succ, copy);
+        }
+        auto succRight = succ->rightEl.load(std::memory_order_relaxed);
+        if (succ == right) {//successor is our right child. Copy takes over both in one step
+            copy->rightEl.store(succRight, std::memory_order_relaxed);
+            publish(*slot, copy);
+            retire(succ);
+        } else {
+            copy->rightEl.store(right, std::memory_order_relaxed);
+            publish(*slot, copy);
+            succ->moved = true; //readers that passed us before the copy was published may be headed to succ
+            stale.emplace_back(succ, epochReclamation::currentEpoch());
+        }
+        retire(me);
+        return true;
+    }
+
+    void finishRemoves() {//writer. Never waits, unlinks what has waited long enough
+        if (!stale.empty()) {
+            epochReclamation::tryAdvance();
+            epochReclamation::tryAdvance(); //two steps if nobody is pinned, then the newest entry is safe too
+            size_t kept = 0;
+            for (auto& entry : stale) {
+                if (epochReclamation::isSafe(entry.second)) {//it has no left sub element, everything smaller went left at its copy
+                    publish(*slotOf(entry.first), entry.first->rightEl.load(std::memory_order_relaxed));
+                    retire(entry.first);
+                } else
+                    stale[kept++] = entry;
+            }
+            stale.resize(kept);
+        }
+        for (size_t i = 0; i < tombstones.size();) {
+            if (unlink(slotOf(tombstones[i]), tombstones[i])) {
+                tombstones[i] = tombstones.back();
+                tombstones.pop_back();
+            } else
+                ++i;
+        }
+    }
+
+public:
+    concurrentBintree() = default;
+    concurrentBintree(const concurrentBintree&) = delete;
+    concurrentBintree& operator=(const concurrentBintree&) = delete;
+    ~concurrentBintree() {//No readers or writers may be left. O(N) with a stack of O(depth)
+        std::vector<bintreeElement*> pending;
+        if (auto top = root.load(std::memory_order_relaxed)) pending.push_back(top);
+        while (!pending.empty()) {
+            auto me = pending.back();
+            pending.pop_back();
+            if (auto left = me->leftEl.load(std::memory_order_relaxed)) pending.push_back(left);
+            if (auto right = me->rightEl.load(std::memory_order_relaxed)) pending.push_back(right);
+            deAlloc(me);
+        }
+        for (auto& entry : retired)
+            deAlloc(entry.first);
+    }
+
+    template <typename Func>
+    void inOrder(Func func) const { //O(N) lock-free. Stack of O(depth)
+        epochReclamation::guard pin;
+        std::vector<const bintreeElement*> parents;
+        const bintreeElement* me = read(root);
+        while (me || !parents.empty()) {
+            while (me) {
+                parents.push_back(me);
+                me = read(me->leftEl);
+            }
+            me = parents.back();
+            parents.pop_back();
+            if (!me->removed.load(std::memory_order_acquire)) func(me->value);
+            me = read(me->rightEl);
+        }
+    }
+
+    template <typename Func>
+    void inOrderBackwards(Func func) const { //O(N) lock-free. Stack of O(depth)
+        epochReclamation::guard pin;
+        std::vector<const bintreeElement*> parents;
+        const bintreeElement* me = read(root);
+        while (me || !parents.empty()) {
+            while (me) {
+                parents.push_back(me);
+                me = read(me->rightEl);
+            }
+            me = parents.back();
+            parents.pop_back();
+            if (!me->removed.load(std::memory_order_acquire)) func(me->value);
+            me = read(me->leftEl);
+        }
+    }
+
+    bool contains(const Type& searchVal) const {//(log2 N) to O(N) lock-free
+        epochReclamation::guard pin;
+        return findElement(searchVal) != nullptr;
+    }
+
+    bool find(const Type& searchVal, Type& out) const {//lock-free. Copies the element equal to searchVal into out
+        epochReclamation::guard pin;
+        auto el = findElement(searchVal);
+        if (!el) return false;
+        out = el->value;
+        return true;
+    }
+
+    void emplace(Type&& elem) {//O(N) on empty tree or worst case. O(log2 N) on balanced tree. Serialized with other writers
+        std::lock_guard<std::mutex> guard(writerLock);
+        finishRemoves();
+        auto newEl = alloc(std::forward<Type>(elem));
+        link* slot = &root;
+        while (auto me = slot->load(std::memory_order_relaxed))
+            slot = (newEl->value < me->value) ? &me->leftEl : &me->rightEl;
+        publish(*slot, newEl); //newEl is fully built before readers can see it
+        elemCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void insert(Type elem) {
+        emplace(std::forward<Type>(elem));
+    }
+
+    void remove(const Type& elem) {//O(depth). Serialized with other writers, never waits for readers
+        std::lock_guard<std::mutex> guard(writerLock);
+        finishRemoves();
+        link* slot = &root;
+        bintreeElement* me;
+        while ((me = slot->load(std::memory_order_relaxed)) && (me->value != elem || me->moved || me->removed.load(std::memory_order_relaxed)))
+            slot = (elem < me->value) ? &me->leftEl : &me->rightEl;
+        if (!me) return; //elem doesn't exist
+        elemCount.fetch_sub(1, std::memory_order_relaxed);
+        if (!unlink(slot, me)) {
+            me->removed.store(true, std::memory_order_release);
+            tombstones.push_back(me);
+        }
+        finishRemoves();
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount.load(std::memory_order_relaxed);
+    }
+    bool empty() const {
+        return count() == 0;
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include "poolAlloc.h"
+
+/*
+frozen binary tree
+Immutable snapshot of a bintree, see bintree::freeze(). Keys are stored in Eytzinger (BFS) order in one array:
+the children of index k are 2k and 2k+1, index 0 is unused. The upper levels share a few cache lines and
+search needs no pointers and no branches besides the loop.
+*/
+
+template<class Type>
+class frozenBintree {
+    std::vector<Type> data; //data[1..count]
+    size_t elemCount = 0;
+
+    //descendants this many levels down lie next to each other. Prefetch as many levels as fit in a cache line, atleast the grandchildren
+    static const size_t prefetchLevels = (sizeof(Type) <= 4) ? 4 : (sizeof(Type) <= 8) ? 3 : 2;
+
+    size_t first() const noexcept {//leftmost index
+        size_t k = 1;
+        while (2 * k <= elemCount)
+            k = 2 * k;
+        return elemCount ? k : 0;
+    }
+    size_t last() const noexcept {//rightmost index
+        size_t k = 1;
+        while (2 * k + 1 <= elemCount)
+            k = 2 * k + 1;
+        return elemCount ? k : 0;
+    }
+    size_t next(size_t k) const noexcept {//in-order successor. 0 after the last element
+        if (2 * k + 1 <= elemCount) {
+            k = 2 * k + 1;
+            while (2 * k <= elemCount)
+                k = 2 * k;
+            return k;
+        }
+        while (k & 1) //climb while we are a right child
+            k >>= 1;
+        return k >> 1;
+    }
+    size_t previous(size_t k) const noexcept {//in-order predecessor. 0 before the first element
+        if (2 * k <= elemCount) {
+            k = 2 * k;
+            while (2 * k + 1 <= elemCount)
+                k = 2 * k + 1;
+            return k;
+        }
+        while (!(k & 1)) //climb while we are a left child
+            k >>= 1;
+        return k >> 1;
+    }
+
+    size_t lowerBoundIndex(const Type& searchVal) const noexcept {//O(log2 N) branchless. 0 if every element is smaller
+        size_t k = 1;
+        while (k <= elemCount) {
+            //the lowest levels prefetch far past the end. Integer math, a pointer there would be undefined behaviour
+            prefetchRead(reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(data.data()) + (k << prefetchLevels) * sizeof(Type)));
+            k = 2 * k + (data[k] < searchVal);
+        }
+        //k walked past the leaf. The answer is where we last went left: drop the trailing right turns (1 bits) and that left turn
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+public:
+    frozenBintree() = default;
+
+    //O(N). [first, last) has to be sorted
+    template<class ForwardIterator>
+    frozenBintree(ForwardIterator first, ForwardIterator last) {
+        elemCount = std::distance(first, last);
+        if (!elemCount) return;
+        data.resize(elemCount + 1);
+        for (size_t k = this->first(); first != last; ++first, k = next(k))
+            data[k] = *first;
+    }
+
+    class iterator : public std::iterator<std::bidirectional_iterator_tag, Type> {
+        size_t me = 0;
+        const frozenBintree* tree;
+    public:
+        explicit iterator(const frozenBintree& ft, size_t st) : me(st), tree(&ft) {}
+
+        iterator& operator++() {
+            me = tree->next(me);
+            return *this;
+        } // prefix++
+        iterator  operator++(int) {
+            iterator tmp(*this);
+            me = tree->next(me);
+            return tmp;
+        } // postfix++
+        iterator& operator--() {
+            me = me ? tree->previous(me) : tree->last();
+            return *this;
+        } // prefix--
+        iterator  operator--(int) {
+            iterator tmp(*this);
+            --*this;
+            return tmp;
+        } // postfix--
+
+        bool operator==(const iterator& other) const { return me == other.me; }
+        bool operator!=(const iterator& other) const { return me != other.me; }
+
+        const Type& operator*() { return tree->data[me]; }
+        const Type* operator->() { return &tree->data[me]; }
+        explicit operator Type() const { return tree->data[me]; }
+    };
+
+    template <typename Func>
+    void inOrder(Func func) const { //O(N)
+        for (size_t k = first(); k; k = next(k))
+            func(data[k]);
+    }
+
+    bool contains(const Type& searchVal) const noexcept {//O(log2 N)
+        auto k = lowerBoundIndex(searchVal);
+        return k && !(searchVal < data[k]);
+    }
+    iterator lower_bound(const Type& searchVal) const noexcept {//O(log2 N) first element not less than searchVal
+        return iterator(*this, lowerBoundIndex(searchVal));
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount;
+    }
+    iterator begin() const {
+        return iterator(*this, first());
+    }
+    iterator end() const {
+        return iterator(*this, 0);
+    }
+    bool empty() const {
+        return elemCount == 0;
+    }
+};
@@ -0,0 +1,271 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include "bintree_concurrent.h"
+
+/*
+lock-free binary tree, after Natarajan and Mittal "Fast Concurrent Lock-Free Binary Search Trees"
+External tree: values live in the leaves, inner elements only route (left is smaller, right is bigger or equal).
+Every change is one CAS on a child link, so any number of threads insert, remove and look up at the same time without locks.
+A link carries two marks. flag: the leaf it points to is being removed. tag: the link is frozen because its parent is being removed.
+remove flags the link to the leaf, tags the sibling link and then swings the link of the lowest unmarked ancestor past both.
+Threads that run into marked links finish the pending remove first. Each value is stored atmost once.
+Unlinked elements are freed through epochReclamation. Alloc has to be safe to use from several threads at once.
+*/
+template<class Type>
+class lockFreeBintreeElement {
+public:
+    std::atomic<uintptr_t> leftEl{ 0 }; //element pointer | flag | tag. 0 on leaves
+    std::atomic<uintptr_t> rightEl{ 0 };
+    Type value;
+    uint8_t infinity; //0 for real values. 1..3 are sentinel keys bigger than every value
+
+    lockFreeBintreeElement(const Type& v, uint8_t inf) : value(v), infinity(inf) {}
+};
+
+template<class Type, class Alloc = std::allocator<lockFreeBintreeElement<Type>>>
+class lockFreeBintree {
+    using bintreeElement = lockFreeBintreeElement<Type>;
+    using link = std::atomic<uintptr_t>;
+    using nodeAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<bintreeElement>;
+    static const uintptr_t flagBit = 1;
+    static const uintptr_t tagBit = 2;
+
+    nodeAllocator allocator = nodeAllocator();
+    bintreeElement* alloc(const Type& initV, uint8_t infinity) {
+        auto newElem = allocator.allocate(1);
+        ::new(newElem) bintreeElement(initV, infinity);
+        return newElem;
+    }
+    void deAlloc(bintreeElement* elem) {
+        elem->~bintreeElement();
+        allocator.deallocate(elem, 1);
+    }
+
+    //rootEl has key infinity 3, its left is the inner sentinel with infinity 2. Every real value is in the left subtree of that
+    bintreeElement* rootEl;
+    std::atomic<uint64_t> elemCount{ 0 };
+
+    struct retiredElement {
+        bintreeElement* el;
+        uint64_t epoch;
+        retiredElement* next;
+    };
+    std::atomic<retiredElement*> retired{ nullptr }; //push only stack, reclaim takes it whole
+    std::atomic<uint32_t> retiredCount{ 0 };
+
+    static bintreeElement* address(uintptr_t l) noexcept {
+        return reinterpret_cast<bintreeElement*>(l & ~(flagBit | tagBit));
+    }
+    static uintptr_t clean(const bintreeElement* el) noexcept {
+        return reinterpret_cast<uintptr_t>(el);
+    }
+    static bool goesLeft(const Type& key, const bintreeElement* el) noexcept {
+        return el->infinity || key < el->value;
+    }
+    static link& childToward(const Type& key, bintreeElement* el) noexcept {
+        return goesLeft(key, el) ? el->leftEl : el->rightEl;
+    }
+    static bool holds(const bintreeElement* leaf, const Type& key) noexcept {
+        return !leaf->infinity && leaf->value == key;
+    }
+
+    struct seekRecord {
+        bintreeElement* ancestor;  //lowest element whose link down the path is not tagged
+        bintreeElement* successor; //its child on the path. Everything from here down to parent is cut out by a remove
+        bintreeElement* parent;
+        bintreeElement* leaf;
+    };
+
+    seekRecord seek(const Type& key) const noexcept {//caller is pinned
+        auto sentinel = address(rootEl->leftEl.load(std::memory_order_acquire));
+        auto parentField = sentinel->leftEl.load(std::memory_order_acquire);
+        seekRecord rec{ rootEl, sentinel, sentinel, address(parentField) };
+        auto currentField = childToward(key, rec.leaf).load(std::memory_order_acquire);
+        while (auto current = address(currentField)) {
+            if (!(parentField & tagBit)) {
+                rec.ancestor = rec.parent;
+                rec.successor = rec.leaf;
+            }
+            rec.parent = rec.leaf;
+            rec.leaf = current;
+            parentField = currentField;
+            currentField = childToward(key, current).load(std::memory_order_acquire);
+        }
+        return rec;
+    }
+
+    void retire(bintreeElement* el) {
+        auto rec = new retiredElement{ el, epochReclamation::currentEpoch(), retired.load(std::memory_order_relaxed) };
+        while (!retired.compare_exchange_weak(rec->next, rec, std::memory_order_release, std::memory_order_relaxed));
+        if (retiredCount.fetch_add(1, std::memory_order_relaxed) % 128 == 127)
+            reclaim();
+    }
+    void reclaim() {//frees what no reader can see anymore, puts the rest back
+        epochReclamation::tryAdvance();
+        auto list = retired.exchange(nullptr, std::memory_order_acquire);
+        retiredElement* kept = nullptr;
+        retiredElement* keptTail = nullptr;
+        while (list) {
+            auto next = list->next;
+            if (epochReclamation::isSafe(list->epoch)) {
+                deAlloc(list->el);
+                delete list;
+            } else {
+                if (!kept) keptTail = list;
+                list->next = kept;
+                kept = list;
+            }
+            list = next;
+        }
+        if (!kept) return;
+        keptTail->next = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(keptTail->next, kept, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    //Finishes the remove of the flagged leaf below rec.parent. Only the thread whose CAS succeeds retires the cut out elements
+    bool cleanup(const Type& key, const seekRecord& rec) {
+        auto& successorLink = childToward(key, rec.ancestor);
+        bool keyLeft = goesLeft(key, rec.parent);
+        link* childLink = keyLeft ? &rec.parent->leftEl : &rec.parent->rightEl;
+        link* siblingLink = keyLeft ? &rec.parent->rightEl : &rec.parent->leftEl;
+        if (!(childLink->load(std::memory_order_acquire) & flagBit))
+            siblingLink = childLink; //the flagged leaf is on the other side
+        //freeze the sibling so nothing is inserted below it, then hang it into the ancestor. Its flag stays
+        auto sibling = siblingLink->fetch_or(tagBit, std::memory_order_acq_rel);
+        auto expected = clean(rec.successor);
+        if (!successorLink.compare_exchange_strong(expected, sibling & ~tagBit, std::memory_order_acq_rel, std::memory_order_acquire))
+            return false;
+        //successor down to parent and their flagged leaves are cut out now. All their links are marked so nothing changes them
+        std::vector<bintreeElement*> pending{ rec.successor };
+        while (!pending.empty()) {
+            auto me = pending.back();
+            pending.pop_back();
+            if (me == address(sibling)) continue;
+            if (auto left = address(me->leftEl.load(std::memory_order_acquire))) {
+                pending.push_back(left);
+                pending.push_back(address(me->rightEl.load(std::memory_order_acquire)));
+            }
+            retire(me);
+        }
+        return true;
+    }
+
+public:
+    lockFreeBintree() {
+        rootEl = alloc(Type(), 3);
+        auto sentinel = alloc(Type(), 2);
+        sentinel->leftEl.store(clean(alloc(Type(), 1)), std::memory_order_relaxed);
+        sentinel->rightEl.store(clean(alloc(Type(), 2)), std::memory_order_relaxed);
+        rootEl->leftEl.store(clean(sentinel), std::memory_order_relaxed);
+        rootEl->rightEl.store(clean(alloc(Type(), 3)), std::memory_order_release);
+    }
+    lockFreeBintree(const lockFreeBintree&) = delete;
+    lockFreeBintree& operator=(const lockFreeBintree&) = delete;
+    ~lockFreeBintree() {//No other thread may be left. O(N) with a stack of O(depth)
+        std::vector<bintreeElement*> pending{ rootEl };
+        while (!pending.empty()) {
+            auto me = pending.back();
+            pending.pop_back();
+            if (auto left = address(me->leftEl.load(std::memory_order_relaxed))) {
+                pending.push_back(left);
+                pending.push_back(address(me->rightEl.load(std::memory_order_relaxed)));
+            }
+            deAlloc(me);
+        }
+        auto list = retired.load(std::memory_order_relaxed);
+        while (list) {
+            auto next = list->next;
+            deAlloc(list->el);
+            delete list;
+            list = next;
+        }
+    }
+
+    template <typename Func>
+    void inOrder(Func func) const { //O(N) lock-free. Stack of O(depth). Skips values that are being removed
+        epochReclamation::guard pin;
+        std::vector<uintptr_t> pending{ rootEl->leftEl.load(std::memory_order_acquire) };
+        while (!pending.empty()) {
+            auto field = pending.back();
+            pending.pop_back();
+            auto me = address(field);
+            auto left = me->leftEl.load(std::memory_order_acquire);
+            if (!left) {
+                if (!me->infinity && !(field & flagBit)) func(me->value);
+                continue;
+            }
+            pending.push_back(me->rightEl.load(std::memory_order_acquire));
+            pending.push_back(left);
+        }
+    }
+
+    bool contains(const Type& searchVal) const {//(log2 N) to O(N) lock-free
+        epochReclamation::guard pin;
+        auto me = rootEl;
+        while (auto next = address(childToward(searchVal, me).load(std::memory_order_acquire)))
+            me = next;
+        return holds(me, searchVal);
+    }
+
+    bool insert(Type elem) {//lock-free. false if elem is already in the tree
+        epochReclamation::guard pin;
+        bintreeElement* newLeaf = nullptr;
+        while (true) {
+            auto rec = seek(elem);
+            auto leaf = rec.leaf;
+            if (holds(leaf, elem)) {
+                if (newLeaf) deAlloc(newLeaf);
+                return false;
+            }
+            if (!newLeaf) newLeaf = alloc(elem, 0);
+            //new inner element takes the bigger key of the two leaves. The smaller leaf goes left
+            bool newIsLeft = goesLeft(elem, leaf);
+            auto inner = newIsLeft ? alloc(leaf->value, leaf->infinity) : alloc(elem, 0);
+            inner->leftEl.store(clean(newIsLeft ? newLeaf : leaf), std::memory_order_relaxed);
+            inner->rightEl.store(clean(newIsLeft ? leaf : newLeaf), std::memory_order_relaxed);
+
+            auto& childLink = childToward(elem, rec.parent);
+            auto expected = clean(leaf);
+            if (childLink.compare_exchange_strong(expected, clean(inner), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                elemCount.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            deAlloc(inner); //never published
+            if (address(expected) == leaf && (expected & (flagBit | tagBit)))
+                cleanup(elem, rec); //a remove is in our way. Help it along
+        }
+    }
+
+    bool remove(const Type& elem) {//lock-free. false if elem is not in the tree
+        epochReclamation::guard pin;
+        bintreeElement* flagged = nullptr; //our leaf once we flagged it. The remove takes effect there
+        while (true) {
+            auto rec = seek(elem);
+            if (!flagged) {
+                if (!holds(rec.leaf, elem)) return false;
+                auto& childLink = childToward(elem, rec.parent);
+                auto expected = clean(rec.leaf);
+                if (childLink.compare_exchange_strong(expected, expected | flagBit, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    flagged = rec.leaf;
+                    elemCount.fetch_sub(1, std::memory_order_relaxed);
+                    if (cleanup(elem, rec)) return true;
+                } else if (address(expected) == rec.leaf && (expected & (flagBit | tagBit))) {
+                    cleanup(elem, rec);
+                }
+            } else {
+                if (rec.leaf != flagged) return true; //another thread already cut it out. We are pinned, so the address can't be reused
+                if (cleanup(elem, rec)) return true;
+            }
+        }
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount.load(std::memory_order_relaxed);
+    }
+    bool empty() const noexcept {
+        return count() == 0;
+    }
+};
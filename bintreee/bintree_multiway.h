@@ -0,0 +1,502 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include "poolAlloc.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MULTIWAY_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MULTIWAY_SSE2
+#endif
+
+/*
+multiway tree
+B+ tree with the interface of bintree. The node header and up to leafKeys sorted keys share one cache line (two for keys above 6 bytes),
+so a lookup reads one line per leaf and two per inner node (keys, then the line with the child pointer) instead of one per key. All keys live in the leaves, leaves are linked for iteration.
+Inner keys only route: everything left of keys[i] is <= keys[i] <= everything right of it. Duplicates are allowed.
+*/
+
+template<class Type>
+struct multiwayKeySearch {//Number of keys < searchVal. Branchless scan
+    template<size_t capacity>
+    static uint32_t countLess(const Type(&keys)[capacity], uint32_t count, const Type& searchVal) {
+        uint32_t less = 0;
+        for (uint32_t i = 0; i < count; ++i)
+            less += keys[i] < searchVal;
+        return less;
+    }
+};
+
+#if defined(MULTIWAY_AVX2) || defined(MULTIWAY_SSE2)
+template<bool isSigned, size_t capacity>
+inline uint32_t countLess32(const void* keys, uint32_t count, uint32_t searchVal) {//Compares whole vectors, then masks off the unused slots. Reads up to capacity rounded up to 8 keys
+    static_assert(capacity <= 32, "mask is 32 bit");
+    const int flip = isSigned ? 0 : int(0x80000000u); //SSE only compares signed. Flipping the sign bit orders unsigned values the same way
+    uint32_t mask = 0;
+#ifdef MULTIWAY_AVX2
+    auto x = _mm256_set1_epi32(int(searchVal) ^ flip);
+    auto f = _mm256_set1_epi32(flip);
+    for (size_t i = 0; i < capacity; i += 8) {//a partial last vector reads past the keys, the node keeps that much room after them
+        auto k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(static_cast<const uint32_t*>(keys) + i)), f);
+        mask |= uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, k)))) << i;
+    }
+#else
+    auto x = _mm_set1_epi32(int(searchVal) ^ flip);
+    auto f = _mm_set1_epi32(flip);
+    for (size_t i = 0; i < capacity; i += 4) {//a partial last vector reads past the keys, the node keeps that much room after them
+        auto k = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(static_cast<const uint32_t*>(keys) + i)), f);
+        mask |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(x, k)))) << i;
+    }
+#endif
+    mask &= (count >= 32) ? ~0u : ((1u << count) - 1);
+    return countTrailingZeros(~uint64_t(mask)); //keys are sorted so the set bits are a prefix
+}
+
+template<>
+struct multiwayKeySearch<uint32_t> {
+    template<size_t capacity>
+    static uint32_t countLess(const uint32_t(&keys)[capacity], uint32_t count, uint32_t searchVal) {
+        return countLess32<false, capacity>(keys, count, searchVal);
+    }
+};
+
+template<>
+struct multiwayKeySearch<int32_t> {
+    template<size_t capacity>
+    static uint32_t countLess(const int32_t(&keys)[capacity], uint32_t count, int32_t searchVal) {
+        return countLess32<true, capacity>(keys, count, uint32_t(searchVal));
+    }
+};
+#endif
+
+template<class Type>
+class multiwayBintree {
+    struct node {//keys follow right after this in the derived node
+        uint16_t count = 0;
+        bool leaf;
+        explicit node(bool isLeaf) : leaf(isLeaf) {}
+    };
+    static const size_t keyOffset = (sizeof(node) + alignof(Type) - 1) / alignof(Type) * alignof(Type);
+    static const size_t keyLines = ((64 - keyOffset) / sizeof(Type) >= 8) ? 1 : 2; //header and keys
+    static const size_t nodeBytes = keyLines * 64 + 64; //one more line for the leaf links or the child pointers
+public:
+    static const uint32_t leafKeys = (keyLines * 64 - keyOffset) / sizeof(Type) > 3 ? (keyLines * 64 - keyOffset) / sizeof(Type) : 3; //15 uint32_t
+    static const uint32_t innerKeys = (nodeBytes - keyOffset - 2 * sizeof(void*)) / (sizeof(Type) + sizeof(void*)) > 3 ?
+        (nodeBytes - keyOffset - 2 * sizeof(void*)) / (sizeof(Type) + sizeof(void*)) : 3; //9 uint32_t and 10 children in 128 bytes
+private:
+    static const uint32_t minLeafKeys = leafKeys / 2; //every node but the root keeps atleast this many
+    static const uint32_t minInnerKeys = innerKeys / 2;
+    static const size_t maxDepth = 40;
+    using search = multiwayKeySearch<Type>;
+
+    struct alignas(64) leafNode : node {
+        Type keys[leafKeys];
+        leafNode* next = nullptr;
+        leafNode* prev = nullptr;
+        leafNode() : node(true), keys() {}
+    };
+    struct alignas(64) innerNode : node {
+        Type keys[innerKeys];
+        node* children[innerKeys + 1];
+        innerNode() : node(false), keys() {}
+    };
+    static_assert(sizeof(Type) > 8 || sizeof(innerNode) <= nodeBytes, "inner node spills into another line");
+    static_assert(sizeof(Type) != 4 || (keyOffset + (innerKeys + 7) / 8 * 8 * sizeof(Type) <= sizeof(innerNode) &&
+        keyOffset + (leafKeys + 7) / 8 * 8 * sizeof(Type) <= sizeof(leafNode)), "vector key search reads whole vectors");
+
+    struct pathStep {//inner node and which child we went down to
+        innerNode* me;
+        uint32_t child;
+    };
+    struct path {
+        pathStep steps[maxDepth];
+        size_t depth = 0;
+        leafNode* leaf = nullptr;
+    };
+
+    node* root = nullptr;
+    leafNode* firstLeaf = nullptr;
+    leafNode* lastLeaf = nullptr;
+    uint32_t elemCount = 0;
+
+    template<class NodeType>
+    static NodeType* alloc() {
+        return ::new(alignedAlloc(sizeof(NodeType), alignof(NodeType))) NodeType();
+    }
+    template<class NodeType>
+    static void deAlloc(NodeType* me) noexcept {
+        me->~NodeType();
+        alignedFree(me);
+    }
+
+    static void freeSubtree(node* me) noexcept {//recursion depth is the tree height, log N
+        if (me->leaf) {
+            deAlloc(static_cast<leafNode*>(me));
+            return;
+        }
+        auto in = static_cast<innerNode*>(me);
+        for (uint32_t i = 0; i <= in->count; ++i)
+            freeSubtree(in->children[i]);
+        deAlloc(in);
+    }
+
+    template<class Array, class Value>
+    static void insertAt(Array& arr, uint32_t count, uint32_t pos, Value&& val) {//arr has room for count + 1
+        std::move_backward(arr + pos, arr + count, arr + count + 1);
+        arr[pos] = std::forward<Value>(val);
+    }
+    template<class Array>
+    static void eraseAt(Array& arr, uint32_t count, uint32_t pos) {
+        std::move(arr + pos + 1, arr + count, arr + pos);
+    }
+
+    path descend(const Type& searchVal) const {//Leaf that holds the first element not less than searchVal, or the one before it
+        path p;
+        auto me = root;
+        while (!me->leaf) {
+            auto in = static_cast<innerNode*>(me);
+            auto child = search::countLess(in->keys, in->count, searchVal);
+            p.steps[p.depth++] = { in, child };
+            me = in->children[child];
+        }
+        p.leaf = static_cast<leafNode*>(me);
+        return p;
+    }
+
+    static bool nextLeaf(path& p) {//moves the path to the following leaf
+        size_t level = p.depth;
+        while (level && p.steps[level - 1].child == p.steps[level - 1].me->count)
+            --level;
+        if (!level) return false;
+        auto& step = p.steps[level - 1];
+        node* me = step.me->children[++step.child];
+        p.depth = level;
+        while (!me->leaf) {
+            auto in = static_cast<innerNode*>(me);
+            p.steps[p.depth++] = { in, 0 };
+            me = in->children[0];
+        }
+        p.leaf = static_cast<leafNode*>(me);
+        return true;
+    }
+
+    void insertIntoParent(path& p, size_t level, Type&& separator, node* right) {//right goes next to the child at steps[level - 1]. Splits upwards if full
+        if (!level) {//split the root
+            auto newRoot = alloc<innerNode>();
+            newRoot->keys[0] = std::move(separator);
+            newRoot->children[0] = root;
+            newRoot->children[1] = right;
+            newRoot->count = 1;
+            root = newRoot;
+            return;
+        }
+        auto par = p.steps[level - 1].me;
+        auto pos = p.steps[level - 1].child;
+        if (par->count < innerKeys) {
+            insertAt(par->keys, par->count, pos, std::move(separator));
+            insertAt(par->children, par->count + 1, pos + 1, right);
+            par->count++;
+            return;
+        }
+        //full. Build the overfull key/child lists, the middle key moves up
+        Type keys[innerKeys + 1];
+        node* children[innerKeys + 2];
+        std::move(par->keys, par->keys + innerKeys, keys);
+        std::copy(par->children, par->children + innerKeys + 1, children);
+        insertAt(keys, innerKeys, pos, std::move(separator));
+        insertAt(children, innerKeys + 1, pos + 1, right);
+        const uint32_t mid = (innerKeys + 1) / 2;
+        auto sibling = alloc<innerNode>();
+        par->count = mid;
+        std::move(keys, keys + mid, par->keys);
+        std::copy(children, children + mid + 1, par->children);
+        sibling->count = innerKeys - mid;
+        std::move(keys + mid + 1, keys + innerKeys + 1, sibling->keys);
+        std::copy(children + mid + 1, children + innerKeys + 2, sibling->children);
+        insertIntoParent(p, level - 1, std::move(keys[mid]), sibling);
+    }
+
+    void rebalanceLeaf(path& p) {//leaf has less than minLeafKeys. Borrow from a sibling or merge with it
+        auto me = p.leaf;
+        if (!p.depth) {//root leaf may shrink to nothing
+            if (!me->count) {
+                deAlloc(me);
+                root = nullptr;
+                firstLeaf = lastLeaf = nullptr;
+            }
+            return;
+        }
+        auto par = p.steps[p.depth - 1].me;
+        auto pos = p.steps[p.depth - 1].child;
+        auto left = pos ? static_cast<leafNode*>(par->children[pos - 1]) : nullptr;
+        auto right = (pos < par->count) ? static_cast<leafNode*>(par->children[pos + 1]) : nullptr;
+        if (left && left->count > minLeafKeys) {
+            insertAt(me->keys, me->count, 0, std::move(left->keys[left->count - 1]));
+            me->count++;
+            left->count--;
+            par->keys[pos - 1] = left->keys[left->count - 1];
+            return;
+        }
+        if (right && right->count > minLeafKeys) {
+            me->keys[me->count++] = std::move(right->keys[0]);
+            eraseAt(right->keys, right->count, 0);
+            right->count--;
+            par->keys[pos] = me->keys[me->count - 1];
+            return;
+        }
+        //merge the right one of the pair into the left one
+        if (!left) {
+            left = me;
+            me = right;
+            ++pos;
+        }
+        std::move(me->keys, me->keys + me->count, left->keys + left->count);
+        left->count += me->count;
+        left->next = me->next;
+        if (me->next) me->next->prev = left;
+        else lastLeaf = left;
+        deAlloc(me);
+        eraseAt(par->keys, par->count, pos - 1);
+        eraseAt(par->children, par->count + 1, pos);
+        par->count--;
+        rebalanceInner(p, p.depth - 1);
+    }
+
+    void rebalanceInner(path& p, size_t level) {//steps[level].me lost a child
+        auto me = p.steps[level].me;
+        if (!level) {//root
+            if (!me->count) {
+                root = me->children[0];
+                deAlloc(me);
+            }
+            return;
+        }
+        if (me->count >= minInnerKeys) return;
+        auto par = p.steps[level - 1].me;
+        auto pos = p.steps[level - 1].child;
+        auto left = pos ? static_cast<innerNode*>(par->children[pos - 1]) : nullptr;
+        auto right = (pos < par->count) ? static_cast<innerNode*>(par->children[pos + 1]) : nullptr;
+        if (left && left->count > minInnerKeys) {//rotate right through the parent
+            insertAt(me->keys, me->count, 0, std::move(par->keys[pos - 1]));
+            insertAt(me->children, me->count + 1, 0, left->children[left->count]);
+            me->count++;
+            par->keys[pos - 1] = std::move(left->keys[left->count - 1]);
+            left->count--;
+            return;
+        }
+        if (right && right->count > minInnerKeys) {//rotate left through the parent
+            me->keys[me->count] = std::move(par->keys[pos]);
+            me->children[me->count + 1] = right->children[0];
+            me->count++;
+            par->keys[pos] = std::move(right->keys[0]);
+            eraseAt(right->keys, right->count, 0);
+            eraseAt(right->children, right->count + 1, 0);
+            right->count--;
+            return;
+        }
+        if (!left) {
+            left = me;
+            me = right;
+            ++pos;
+        }
+        left->keys[left->count] = std::move(par->keys[pos - 1]);
+        std::move(me->keys, me->keys + me->count, left->keys + left->count + 1);
+        std::copy(me->children, me->children + me->count + 1, left->children + left->count + 1);
+        left->count += me->count + 1;
+        deAlloc(me);
+        eraseAt(par->keys, par->count, pos - 1);
+        eraseAt(par->children, par->count + 1, pos);
+        par->count--;
+        rebalanceInner(p, level - 1);
+    }
+
+public:
+    multiwayBintree() = default;
+    multiwayBintree(const multiwayBintree&) = delete;
+    multiwayBintree& operator=(const multiwayBintree&) = delete;
+    multiwayBintree(multiwayBintree&& other) {
+        swap(other);
+    }
+    multiwayBintree& operator=(multiwayBintree&& other) {
+        swap(other);
+        return *this;
+    }
+    ~multiwayBintree() {
+        clear();
+    }
+
+    static const size_t leafBytes = sizeof(leafNode);
+
+    class iterator : public std::iterator<std::bidirectional_iterator_tag, Type> {
+        const leafNode* me = nullptr;
+        uint32_t index = 0;
+        const multiwayBintree* tree;
+    public:
+        explicit iterator(const multiwayBintree& bt, const leafNode* st, uint32_t idx) : me(st), index(idx), tree(&bt) {}
+
+        iterator& operator++() {
+            if (++index == me->count) {
+                me = me->next;
+                index = 0;
+            }
+            return *this;
+        } // prefix++
+        iterator  operator++(int) {
+            iterator tmp(*this);
+            ++*this;
+            return tmp;
+        } // postfix++
+        iterator& operator--() {
+            if (!me) {
+                me = tree->lastLeaf;
+                index = me->count - 1;
+            } else if (!index) {
+                me = me->prev;
+                index = me->count - 1;
+            } else
+                --index;
+            return *this;
+        } // prefix--
+        iterator  operator--(int) {
+            iterator tmp(*this);
+            --*this;
+            return tmp;
+        } // postfix--
+
+        bool operator==(const iterator& other) const { return me == other.me && index == other.index; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+        const Type& operator*() { return me->keys[index]; }
+        const Type* operator->() { return &me->keys[index]; }
+        explicit operator Type() const { return me->keys[index]; }
+    };
+
+    template <typename Func>
+    void inOrder(Func func) const { //O(N)
+        for (auto leaf = firstLeaf; leaf; leaf = leaf->next)
+            for (uint32_t i = 0; i < leaf->count; ++i)
+                func(leaf->keys[i]);
+    }
+
+    template <typename Func>
+    void inOrderBackwards(Func func) const { //O(N)
+        for (auto leaf = lastLeaf; leaf; leaf = leaf->prev)
+            for (uint32_t i = leaf->count; i-- > 0;)
+                func(leaf->keys[i]);
+    }
+
+    size_t depth() const {//O(log N) all leaves are on the same level
+        size_t level = 0;
+        for (auto me = root; me; me = me->leaf ? nullptr : static_cast<innerNode*>(me)->children[0])
+            ++level;
+        return level;
+    }
+
+    const Type& emplace(Type&& elem) {//O(log N)
+        ++elemCount;
+        if (!root) {
+            auto leaf = alloc<leafNode>();
+            leaf->keys[0] = std::forward<Type>(elem);
+            leaf->count = 1;
+            root = firstLeaf = lastLeaf = leaf;
+            return leaf->keys[0];
+        }
+        auto p = descend(elem);
+        auto leaf = p.leaf;
+        auto pos = search::countLess(leaf->keys, leaf->count, elem);
+        if (leaf->count < leafKeys) {
+            insertAt(leaf->keys, leaf->count, pos, std::forward<Type>(elem));
+            leaf->count++;
+            return leaf->keys[pos];
+        }
+        //full. Split in half, the separator is the biggest key of the left half
+        auto right = alloc<leafNode>();
+        const uint32_t half = leafKeys / 2;
+        std::move(leaf->keys + half, leaf->keys + leafKeys, right->keys);
+        right->count = leafKeys - half;
+        leaf->count = half;
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next) leaf->next->prev = right;
+        else lastLeaf = right;
+        leaf->next = right;
+        auto target = (pos <= half) ? leaf : right;
+        if (target == right) pos -= half;
+        insertAt(target->keys, target->count, pos, std::forward<Type>(elem));
+        target->count++;
+        const Type& inserted = target->keys[pos];
+        insertIntoParent(p, p.depth, Type(leaf->keys[leaf->count - 1]), right);
+        return inserted;
+    }
+
+    const Type& insert(Type elem) {//O(log N)
+        return emplace(std::forward<Type>(elem));
+    }
+
+    void remove(Type elem) {//O(log N). Removes one element equal to elem
+        if (!root) return;
+        auto p = descend(elem);
+        auto pos = search::countLess(p.leaf->keys, p.leaf->count, elem);
+        if (pos == p.leaf->count) {//everything here is smaller. The next leaf may start with elem
+            if (!nextLeaf(p)) return;
+            pos = 0;
+        }
+        if (elem < p.leaf->keys[pos]) return; //elem doesn't exist
+        eraseAt(p.leaf->keys, p.leaf->count, pos);
+        p.leaf->count--;
+        --elemCount;
+        if (p.leaf->count < minLeafKeys)
+            rebalanceLeaf(p);
+    }
+
+    iterator lower_bound(const Type& searchVal) const {//O(log N) first element not less than searchVal
+        if (!root) return end();
+        auto p = descend(searchVal);
+        auto pos = search::countLess(p.leaf->keys, p.leaf->count, searchVal);
+        if (pos == p.leaf->count)
+            return iterator(*this, p.leaf->next, 0);
+        return iterator(*this, p.leaf, pos);
+    }
+    bool contains(const Type& searchVal) const {//O(log N)
+        auto it = lower_bound(searchVal);
+        return it != end() && !(searchVal < *it);
+    }
+
+    void clear() {
+        if (root) freeSubtree(root);
+        root = nullptr;
+        firstLeaf = lastLeaf = nullptr;
+        elemCount = 0;
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount;
+    }
+    Type minValue() const {//O(1). Type() on an empty tree
+        if (!firstLeaf) return Type();
+        return firstLeaf->keys[0];
+    }
+    Type maxValue() const {//O(1). Type() on an empty tree
+        if (!lastLeaf) return Type();
+        return lastLeaf->keys[lastLeaf->count - 1];
+    }
+
+    iterator begin() const {
+        return iterator(*this, firstLeaf, 0);
+    }
+    iterator end() const {
+        return iterator(*this, nullptr, 0);
+    }
+    bool empty() const {
+        return root == nullptr;
+    }
+    void swap(multiwayBintree& other) {
+        std::swap(root, other.root);
+        std::swap(firstLeaf, other.firstLeaf);
+        std::swap(lastLeaf, other.lastLeaf);
+        std::swap(elemCount, other.elemCount);
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+/*
+key-range sharded binary tree
+Splits the key space over independent trees. Shard i holds the values in [splitPoints[i-1], splitPoints[i]) and has its own lock
+and, through Tree's allocator, its own pool. insert_batch routes a batch to the shards and fills them in parallel on std::thread workers.
+Split points are taken from quantiles of the contents plus the first batch, or of the contents once single inserts put
+minRebalanceCount values per shard into shard 0. Values inserted before that are moved to their shards then. Once the biggest shard holds twice its share, every value is redistributed
+and the split points are recomputed from the actual contents. Iteration walks the shards in order, so inOrder sees one sorted sequence.
+Tree is the shard type, e.g. bintree<uint32_t, poolAllocator<bintreeElement<uint32_t>>, bintreeRedBlack>.
+*/
+template<class Type, class Tree>
+class shardedBintree {
+    struct shard {
+        std::mutex lock;
+        Tree tree;
+    };
+    std::vector<std::unique_ptr<shard>> shards;
+    std::vector<Type> splitPoints; //shards.size() - 1 ascending values once chosen, empty before the first batch
+    mutable std::shared_timed_mutex splitLock; //shared for every operation, exclusive while split points change
+    uint64_t rebalancedAt = 0; //count at the last rebalance. Next one only after 50% growth, so moving stays amortized O(1) per insert
+
+    static const size_t minRebalanceCount = 1024; //per shard. Smaller trees aren't worth moving
+
+    size_t shardOf(const Type& value) const {//O(log2 K)
+        return std::upper_bound(splitPoints.begin(), splitPoints.end(), value) - splitPoints.begin();
+    }
+
+    void chooseSplitPoints(const std::vector<Type>& sorted) {//K-quantiles of sorted
+        splitPoints.clear();
+        for (size_t i = 1; i < shards.size(); ++i)
+            splitPoints.push_back(sorted[sorted.size() * i / shards.size()]);
+    }
+
+    template <typename Func>
+    void forEachShard(Func func) {//func(index) on one thread per shard
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < shards.size(); ++i)
+            workers.emplace_back(func, i);
+        func(0);
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    bool unbalanced() const {//caller holds splitLock
+        uint64_t biggest = 0;
+        uint64_t total = 0;
+        for (auto& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh->lock);
+            biggest = std::max<uint64_t>(biggest, sh->tree.count());
+            total += sh->tree.count();
+        }
+        return shards.size() > 1 && total >= minRebalanceCount * shards.size() && 2 * total >= 3 * rebalancedAt && biggest * shards.size() > 2 * total;
+    }
+
+    void redistribute(const std::vector<Type>& sorted) {//O(N). sorted is the whole content. Caller holds splitLock exclusively and chose new split points
+        std::vector<size_t> bounds{ 0 };
+        for (auto& split : splitPoints)
+            bounds.push_back(std::lower_bound(sorted.begin(), sorted.end(), split) - sorted.begin());
+        bounds.push_back(sorted.size());
+        forEachShard([&](size_t i) {//bulk build is O(n) per shard and balanced
+            shards[i]->tree = Tree(sorted.begin() + bounds[i], sorted.begin() + bounds[i + 1]);
+        });
+    }
+
+    void rebalance() {//O(N). Moves every value to its shard under new split points taken from the contents
+        std::unique_lock<std::shared_timed_mutex> exclusive(splitLock);
+        if (!unbalanced()) return; //another batch was faster
+        std::vector<Type> sorted;
+        for (auto& sh : shards)
+            sh->tree.inOrder([&sorted](const Type& el) {
+                sorted.emplace_back(el);
+            });
+        rebalancedAt = sorted.size();
+        chooseSplitPoints(sorted);
+        redistribute(sorted);
+    }
+
+    template<class ForwardIterator>
+    void chooseFirstSplitPoints(ForwardIterator first, ForwardIterator last) {//O(N + n). Quantiles of a sample of the contents and the batch
+        std::unique_lock<std::shared_timed_mutex> exclusive(splitLock);
+        if (!splitPoints.empty()) return; //another thread was faster
+        std::vector<Type> sorted; //without split points everything is in shard 0
+        shards[0]->tree.inOrder([&sorted](const Type& el) {
+            sorted.emplace_back(el);
+        });
+        size_t size = sorted.size() + std::distance(first, last);
+        size_t step = std::max<size_t>(size / 4096, 1);
+        std::vector<Type> sample;
+        for (size_t index = 0; index < sorted.size(); index += step)
+            sample.push_back(sorted[index]);
+        size_t index = 0;
+        for (auto it = first; it != last; ++it, ++index)
+            if (index % step == 0) sample.push_back(*it);
+        if (sample.empty()) return;
+        std::sort(sample.begin(), sample.end());
+        chooseSplitPoints(sample);
+        rebalancedAt = sorted.size();
+        if (!sorted.empty()) redistribute(sorted);
+    }
+
+public:
+    explicit shardedBintree(size_t shardCount = std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 0; i < std::max<size_t>(shardCount, 1); ++i)
+            shards.emplace_back(new shard());
+    }
+    shardedBintree(const shardedBintree&) = delete;
+    shardedBintree& operator=(const shardedBintree&) = delete;
+
+    template <typename Func>
+    void inOrder(Func func) { //O(N) shard by shard. Each shard is locked while it is walked
+        std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+        for (auto& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh->lock);
+            sh->tree.inOrder(func);
+        }
+    }
+
+    void insert(Type elem) {//O(log2 K) routing plus the shard's insert. Chooses the first split points, only insert_batch rebalances
+        bool choose;
+        {
+            std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+            auto& sh = *shards[shardOf(elem)];
+            std::lock_guard<std::mutex> guard(sh.lock);
+            sh.tree.insert(std::forward<Type>(elem));
+            choose = splitPoints.empty() && shards.size() > 1 && sh.tree.count() >= minRebalanceCount * shards.size();
+        }
+        if (choose) {
+            const Type* none = nullptr;
+            chooseFirstSplitPoints(none, none);
+        }
+    }
+
+    template<class ForwardIterator>
+    void insert_batch(ForwardIterator first, ForwardIterator last) {//O(n log2 K) routing, then every shard inserts its part on its own thread
+        if (first == last) return;
+        bool choose = false;
+        if (shards.size() > 1) {
+            std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+            choose = splitPoints.empty();
+        }
+        if (choose) //only the first batch needs the exclusive lock
+            chooseFirstSplitPoints(first, last);
+        {
+            std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+            std::vector<std::vector<Type>> buckets(shards.size());
+            for (; first != last; ++first)
+                buckets[shardOf(*first)].push_back(*first);
+            forEachShard([&](size_t i) {
+                std::lock_guard<std::mutex> guard(shards[i]->lock);
+                for (auto& value : buckets[i])
+                    shards[i]->tree.insert(std::move(value));
+            });
+            if (!unbalanced()) return;
+        }
+        rebalance();
+    }
+
+    void remove(Type elem) {//O(log2 K) routing plus the shard's remove
+        std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+        auto& sh = *shards[shardOf(elem)];
+        std::lock_guard<std::mutex> guard(sh.lock);
+        sh.tree.remove(std::forward<Type>(elem));
+    }
+
+    bool contains(const Type& searchVal) {//O(log2 K) routing plus the shard's contains
+        std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+        auto& sh = *shards[shardOf(searchVal)];
+        std::lock_guard<std::mutex> guard(sh.lock);
+        return sh.tree.contains(searchVal);
+    }
+
+    uint64_t count() const {//O(K)
+        std::shared_lock<std::shared_timed_mutex> shared(splitLock);
+        uint64_t total = 0;
+        for (auto& sh : shards) {
+            std::lock_guard<std::mutex> guard(sh->lock);
+            total += sh->tree.count();
+        }
+        return total;
+    }
+    size_t shardCount() const noexcept {
+        return shards.size();
+    }
+    bool empty() const {
+        return count() == 0;
+    }
+    void clear() {//Keeps the split points
+        std::unique_lock<std::shared_timed_mutex> exclusive(splitLock);
+        for (auto& sh : shards)
+            sh->tree.clear();
+    }
+};
@@ -419,24 +419,6 @@ public:
         return emplace(hint, std::forward<Type>(elem));//#TODO we really want to move here.. But we can't move uint32_t
     }
 
-    //void balance(/*std::optional<Type> to_remove = {}*/) {//broken
-    //    std::vector<Type> elements;
-    //    inOrder([&elements](Type el) {
-    //        elements.emplace_back(el);
-    //    });
-    //    bool wasSorted = std::is_sorted(elements.begin(), elements.end());
-    //    if (!wasSorted) __debugbreak();
-    //    //if (to_remove) std::remove_if(elements.begin(), elements.end(), [&to_remove](Type el) {
-    //    //    return (el == *to_remove);
-    //    //});
-    //    //reinsert
-    //    root = std::make_shared<bintreeElement>(0);
-    //    insSortedVec(root, elements, 0, elements.size() - 1);
-    //
-    //}
-
-
-
     void remove(Type elem) {//Same as insert O(N) to O(log2 N) to find element. If element has 2 subelements then another insert with O(N) to O(log2 N)
         if (!root) return;
 
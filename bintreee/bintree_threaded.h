@@ -0,0 +1,289 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+
+/*
+threaded binary tree
+null left/right slots point to the in-order predecessor/successor instead. Bit 0 of the link tells child and thread apart.
+Iterating never climbs back up the tree. Unbalanced, same shape as bintree with bintreeUnbalanced.
+*/
+
+template<class Type>
+class threadedBintreeElement {
+public:
+    class link {
+        uintptr_t bits = 1; //null thread
+    public:
+        static const uintptr_t threadBit = 1;
+        threadedBintreeElement* get() const noexcept { return reinterpret_cast<threadedBintreeElement*>(bits & ~threadBit); }
+        bool isThread() const noexcept { return (bits & threadBit) != 0; }
+        threadedBintreeElement* child() const noexcept { return isThread() ? nullptr : get(); } //nullptr if this is a thread
+        void setChild(threadedBintreeElement* el) noexcept { bits = reinterpret_cast<uintptr_t>(el); }
+        void setThread(threadedBintreeElement* el) noexcept { bits = reinterpret_cast<uintptr_t>(el) | threadBit; }
+    };
+
+    threadedBintreeElement* parent{ nullptr };
+    link leftEl; //child or thread to in-order predecessor
+    link rightEl; //child or thread to in-order successor
+    Type value;
+
+    explicit threadedBintreeElement(threadedBintreeElement* _parent, Type&& v) : parent(_parent), value(std::forward<Type>(v)) {}
+
+    explicit operator const Type&() const {
+        return value;
+    }
+
+    bool hasLeft() const noexcept { return !leftEl.isThread(); }
+    bool hasRight() const noexcept { return !rightEl.isThread(); }
+
+    const threadedBintreeElement* next() const noexcept {//O(1) on threads. Otherwise leftmost of right subtree
+        if (rightEl.isThread()) return rightEl.get();
+        auto me = rightEl.get();
+        while (me->hasLeft())
+            me = me->leftEl.get();
+        return me;
+    }
+
+    const threadedBintreeElement* previous() const noexcept {//O(1) on threads. Otherwise rightmost of left subtree
+        if (leftEl.isThread()) return leftEl.get();
+        auto me = leftEl.get();
+        while (me->hasRight())
+            me = me->rightEl.get();
+        return me;
+    }
+};
+
+template<class Type, class Alloc = std::allocator<threadedBintreeElement<Type>>>
+class threadedBintree {
+    using bintreeElement = threadedBintreeElement<Type>;
+    static_assert(alignof(bintreeElement) > bintreeElement::link::threadBit, "thread bit needs aligned elements");
+    using nodeAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<bintreeElement>;
+    nodeAllocator allocator = nodeAllocator();
+    bintreeElement* alloc(bintreeElement* par, Type&& initV) {
+        auto newElem = allocator.allocate(1);
+        ::new(newElem) bintreeElement(par, std::forward<Type>(initV));
+        return newElem;
+    }
+
+    void deAlloc(bintreeElement* elem) {
+        if (!elem) return;
+        elem->~bintreeElement();
+        allocator.deallocate(elem, 1);
+    }
+
+    bintreeElement* root = nullptr;
+    uint32_t elemCount = 0;
+
+    void replaceChild(bintreeElement* old, bintreeElement* with) {//Hangs 'with' into the child slot of 'old'. Threads are not touched
+        auto par = old->parent;
+        with->parent = par;
+        if (!par) root = with;
+        else if (par->leftEl.child() == old) par->leftEl.setChild(with);
+        else par->rightEl.setChild(with);
+    }
+
+    bintreeElement* leftmostOf(bintreeElement* me) const noexcept {
+        while (me->hasLeft())
+            me = me->leftEl.get();
+        return me;
+    }
+
+    bintreeElement* rightmostOf(bintreeElement* me) const noexcept {
+        while (me->hasRight())
+            me = me->rightEl.get();
+        return me;
+    }
+
+public:
+    threadedBintree() = default;
+    threadedBintree(const threadedBintree&) = delete;
+    threadedBintree& operator=(const threadedBintree&) = delete;
+    ~threadedBintree() {//O(N). In-order walk, every element is freed after its successor is known
+        if (!root) return;
+        auto me = leftmostOf(root);
+        while (me) {
+            auto next = const_cast<bintreeElement*>(me->next());
+            deAlloc(me);
+            me = next;
+        }
+    }
+
+    class iterator : public std::iterator<std::bidirectional_iterator_tag, Type> {
+        const bintreeElement* me = nullptr;
+        const threadedBintree* tree;
+    public:
+        explicit iterator(const threadedBintree& bt, const bintreeElement* st) : me(st), tree(&bt) {}
+
+        iterator& operator++() {
+            me = me->next();
+            return *this;
+        } // prefix++
+        iterator  operator++(int) {
+            iterator tmp(*this);
+            me = me->next();
+            return tmp;
+        } // postfix++
+        iterator& operator--() {
+            me = me ? me->previous() : tree->rightmostOf(tree->root);
+            return *this;
+        } // prefix--
+        iterator  operator--(int) {
+            iterator tmp(*this);
+            --*this;
+            return tmp;
+        } // postfix--
+
+        bool operator==(const iterator& other) const { return me == other.me; }
+        bool operator!=(const iterator& other) const { return me != other.me; }
+
+        const Type& operator*() { return me->value; }
+        const Type* operator->() { return &me->value; }
+        explicit operator Type() const { return me->value; }
+    };
+
+    template <typename Func>
+    void inOrder(Func func) { //O(N). Only follows threads and left spines, never climbs up
+        if (!root) return;
+        for (const bintreeElement* me = leftmostOf(root); me; me = me->next())
+            func(me->value);
+    }
+
+    template <typename Func>
+    void inOrderBackwards(Func func) { //O(N)
+        if (!root) return;
+        for (const bintreeElement* me = rightmostOf(root); me; me = me->previous())
+            func(me->value);
+    }
+
+    size_t depth() const {//O(N) visits every element. Walks down children and back up parents, threads are ignored
+        if (!root) return 0;
+        size_t maxLevel = 0;
+        size_t curLevel = 1;
+        const bintreeElement* me = root;
+        const bintreeElement* lastEl = nullptr;
+        while (me != nullptr) {
+            if (lastEl == me->parent) {
+                maxLevel = std::max(curLevel, maxLevel);
+                if (me->hasLeft()) {
+                    lastEl = me;
+                    me = me->leftEl.get();
+                    curLevel++;
+                    continue;
+                } else {
+                    lastEl = nullptr;
+                }
+            }
+            if (lastEl == me->leftEl.child()) {
+                if (me->hasRight()) {
+                    lastEl = me;
+                    me = me->rightEl.get();
+                    curLevel++;
+                    continue;
+                } else {
+                    lastEl = nullptr;
+                }
+            }
+            if (lastEl == me->rightEl.child()) {
+                lastEl = me;
+                me = me->parent;
+                curLevel--;
+            }
+        }
+        return maxLevel;
+    }
+
+    const Type& emplace(Type&& elem) {//O(N) on empty tree or worst case. O(log2 N) on balanced tree
+        ++elemCount; //#TODO we may reject duplicates
+        if (!root) {
+            root = alloc(nullptr, std::forward<Type>(elem));
+            return root->value;
+        }
+        auto me = root;
+
+        while (true) {
+            if (elem < me->value) {
+                if (!me->hasLeft()) {
+                    auto newEl = alloc(me, std::forward<Type>(elem));
+                    newEl->leftEl = me->leftEl; //our predecessor was me's predecessor
+                    newEl->rightEl.setThread(me);
+                    me->leftEl.setChild(newEl);
+                    return newEl->value;
+                }
+                me = me->leftEl.get();
+            } else {
+                if (!me->hasRight()) {
+                    auto newEl = alloc(me, std::forward<Type>(elem));
+                    newEl->rightEl = me->rightEl; //our successor was me's successor
+                    newEl->leftEl.setThread(me);
+                    me->rightEl.setChild(newEl);
+                    return newEl->value;
+                }
+                me = me->rightEl.get();
+            }
+        }
+    }
+
+    const Type& insert(Type elem) {//O(N) on empty tree or worst case. O(log2 N) on balanced tree
+        return emplace(std::forward<Type>(elem));
+    }
+
+    void remove(Type elem) {//O(depth) to find and unlink. Two sub elements are replaced by the in-order successor
+        auto me = root;
+        while (me && me->value != elem)
+            me = (elem < me->value) ? me->leftEl.child() : me->rightEl.child();
+        if (!me) return; //elem doesn't exist
+
+        auto par = me->parent;
+        if (!me->hasLeft() && !me->hasRight()) {//No sub elements. Parent inherits our thread
+            if (!par) root = nullptr;
+            else if (par->leftEl.child() == me) par->leftEl = me->leftEl;
+            else par->rightEl = me->rightEl;
+        } else if (!me->hasRight()) {//Only left. Predecessor threads to our successor now
+            rightmostOf(me->leftEl.get())->rightEl = me->rightEl;
+            replaceChild(me, me->leftEl.get());
+        } else if (!me->hasLeft()) {//Only right. Successor threads to our predecessor now
+            leftmostOf(me->rightEl.get())->leftEl = me->leftEl;
+            replaceChild(me, me->rightEl.get());
+        } else {//Two sub elements. Successor takes our place
+            auto next = leftmostOf(me->rightEl.get());
+            rightmostOf(me->leftEl.get())->rightEl.setThread(next);
+            if (next != me->rightEl.get()) {
+                auto nextParent = next->parent;
+                if (next->hasRight()) {
+                    nextParent->leftEl.setChild(next->rightEl.get());
+                    next->rightEl.get()->parent = nextParent;
+                } else
+                    nextParent->leftEl.setThread(next);
+                next->rightEl = me->rightEl;
+                me->rightEl.get()->parent = next;
+            }
+            next->leftEl = me->leftEl;
+            me->leftEl.get()->parent = next;
+            replaceChild(me, next);
+        }
+        deAlloc(me);
+        --elemCount;
+    }
+
+    uint64_t count() const noexcept {//O(1)
+        return elemCount;
+    }
+    bool contains(const Type& searchVal) const {//(log2 N) to O(N)
+        auto me = root;
+        while (me && me->value != searchVal)
+            me = (searchVal < me->value) ? me->leftEl.child() : me->rightEl.child();
+        return me != nullptr;
+    }
+
+    iterator begin() const {
+        return iterator(*this, root ? leftmostOf(root) : nullptr);
+    }
+    iterator end() const {
+        return iterator(*this, nullptr);
+    }
+    bool empty() const {
+        return root == nullptr;
+    }
+};
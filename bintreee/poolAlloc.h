@@ -1,108 +1,467 @@
 #pragma once
-#include <bitset>
+#include <cstdint>
 #include <array>
-#include <allocators>
+#include <memory>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <malloc.h>
+#endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+inline unsigned countTrailingZeros(uint64_t val) noexcept {//val must not be 0
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, val);
+    return index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<uint32_t>(val))) return index;
+    _BitScanForward(&index, static_cast<uint32_t>(val >> 32));
+    return index + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(val));
+#endif
+}
+
+inline void* alignedAlloc(size_t size, size_t alignment) {
+#ifdef _MSC_VER
+    void* mem = _aligned_malloc(size, alignment);
+#else
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignment, size)) mem = nullptr;
+#endif
+    if (!mem) throw std::bad_alloc();
+    return mem;
+}
+
+inline void alignedFree(void* mem) noexcept {
+#ifdef _MSC_VER
+    _aligned_free(mem);
+#else
+    free(mem);
+#endif
+}
+
+inline void prefetchRead(const void* ptr) noexcept {//hint only, never faults. ptr may be any address
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(ptr);
+#endif
+}
+
+/*
+Block sources hand out memory for poolAllocBlocks. bytes is always a power of two and the returned memory has to be aligned to it.
+*/
+struct heapBlockSource {//every block is its own heap allocation
+    static void* allocate(size_t bytes) {
+        return alignedAlloc(bytes, bytes);
+    }
+    static void deallocate(void* mem, size_t) noexcept {
+        alignedFree(mem);
+    }
+};
+
+struct hugePageBlockSource {//carves blocks out of big virtual regions, asking for transparent huge pages. Fewer TLB misses when chasing pointers across millions of nodes
+    static const size_t regionBytes = 64u << 20;
+    static const size_t hugePageBytes = 2u << 20;
+#ifdef _WIN32
+    static const size_t regionAlignment = 64u << 10; //VirtualAlloc granularity
+#else
+    static const size_t regionAlignment = hugePageBytes;
+#endif
+
+    static void* allocate(size_t bytes) {
+        auto& st = getState();
+        std::lock_guard<std::mutex> guard(st.lock);
+        auto sizeClass = countTrailingZeros(bytes);
+        if (auto mem = st.freeBlocks[sizeClass]) {//reuse a released block
+            st.freeBlocks[sizeClass] = *static_cast<void**>(mem);
+            return mem;
+        }
+        auto cur = (st.cur + bytes - 1) & ~(uintptr_t(bytes) - 1);
+        if (!st.cur || cur + bytes > st.end) {//new region. Old region's tail is wasted
+            //blocks have to be aligned to their size. Regions only come aligned to regionAlignment, bigger blocks need room to align up
+            auto regionSize = ((bytes > regionBytes) ? bytes : regionBytes) + ((bytes > regionAlignment) ? bytes : 0);
+            auto region = reserveRegion(regionSize);
+            st.cur = region;
+            st.end = region + regionSize;
+            cur = (region + bytes - 1) & ~(uintptr_t(bytes) - 1);
+        }
+        st.cur = cur + bytes;
+        return reinterpret_cast<void*>(cur);
+    }
+
+    static void deallocate(void* mem, size_t bytes) noexcept {//Pages go back to the OS, the address range stays reserved for the next block of same size
+        auto& st = getState();
+#ifdef _WIN32
+        VirtualAlloc(mem, bytes, MEM_RESET, PAGE_READWRITE);
+#else
+        madvise(mem, bytes, MADV_DONTNEED);
+#endif
+        std::lock_guard<std::mutex> guard(st.lock);
+        auto sizeClass = countTrailingZeros(bytes);
+        *static_cast<void**>(mem) = st.freeBlocks[sizeClass];
+        st.freeBlocks[sizeClass] = mem;
+    }
+
+private:
+    struct state {
+        std::mutex lock;
+        uintptr_t cur = 0;
+        uintptr_t end = 0;
+        void* freeBlocks[64] = {}; //released blocks per log2 size
+    };
+    static state& getState() {
+        static state* instance = new state(); //regions are never unmapped
+        return *instance;
+    }
+
+    static uintptr_t reserveRegion(size_t bytes) {//aligned to regionAlignment
+#ifdef _WIN32
+        //Large pages on windows need SeLockMemoryPrivilege. Plain pages, still one contiguous region
+        auto mem = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!mem) throw std::bad_alloc();
+        return reinterpret_cast<uintptr_t>(mem); //64k aligned
+#else
+        auto mem = mmap(nullptr, bytes + hugePageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) throw std::bad_alloc();
+        auto start = (reinterpret_cast<uintptr_t>(mem) + hugePageBytes - 1) & ~(uintptr_t(hugePageBytes) - 1);
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(start), bytes, MADV_HUGEPAGE);
+#endif
+        return start;
+#endif
+    }
+};
 
 template<class Type>
 class poolAllocBlock {
-
-    //using type = Type;
-    //using blockSize = blockSize;
-    //using Type = int;
-    static const size_t blockSize = 4096u / 4;//#TODO force to be multiple of 8
     using Pointer = Type*;
-    using freelistType = std::bitset<blockSize + blockSize % (blockSize <= 32 ? 32 : 64)>;
+    struct alignas(Type) slot {
+        char bytes[sizeof(Type)];
+    };
+    static constexpr size_t nextPowerOfTwo(size_t val) {
+        size_t pow = 1;
+        while (pow < val)
+            pow <<= 1;
+        return pow;
+    }
+public:
+    //Blocks are allocated aligned to their size. The block owning an element is found by masking off the low address bits
+    static const size_t blockBytes = nextPowerOfTwo(1024 * sizeof(slot));
+private:
+    static const size_t wordCount = (blockBytes / sizeof(slot) + 63) / 64;
+    static_assert(wordCount <= 64, "freelist is a two level bitmap of 64 bit words");
+    static const size_t headerBytes = (sizeof(uint64_t) * (wordCount + 2) + 2 * sizeof(void*) + alignof(slot) - 1) / alignof(slot) * alignof(slot);
+    static const size_t blockSize = (blockBytes - headerBytes) / sizeof(slot); //whatever fits behind the header
 public:
-    //#TODO optimize for page size (4096)
-    freelistType freelist;//#TODO subclass and add methods to find first set bit
-    std::array<char[sizeof(Type)], blockSize> data;
-    bool hasFree = true;
+    uint64_t freelist[wordCount];//bit set = slot is free
+    uint64_t freeWords;//bit i set = freelist[i] has atleast one free slot. Two bit scans find a free slot
+    uint32_t freeCount = blockSize;
+    uint32_t blockIndex = 0; //position in poolAllocator::blocks
+    poolAllocBlock* nextFree = nullptr; //poolAllocator's list of blocks that have atleast one free element
+    poolAllocBlock* prevFree = nullptr;
+    std::array<slot, blockSize> data;
 
     poolAllocBlock() noexcept {
-        freelist.set(); //all is free
-        //except placeholders
-        for (auto i = blockSize; i < blockSize + blockSize % (sizeof(freelistType::_Ty)*8); i++) {
-            freelist.set(i, false);
+        freeWords = 0;
+        for (size_t i = 0; i < wordCount; ++i) {//all is free. Except the bits past the end
+            auto bits = (i * 64 < blockSize) ? std::min<size_t>(64, blockSize - i * 64) : 0;
+            freelist[i] = (bits == 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1);
+            if (bits) freeWords |= uint64_t(1) << i;
         }
     }
 
-    bool freeListFastHasFreeCheck() const {
-        auto maxI = (blockSize + blockSize % (sizeof(freelistType::_Ty)*8)) / (sizeof(freelistType::_Ty)*8);
-        for (auto i = 0u; i < maxI; i++) {
-            auto val = freelist._Getword(i);
-            if (freelist._Getword(i)) return true;
-        }
-        return false;
+    template<class BlockSource>
+    static poolAllocBlock* create() {
+        static_assert(sizeof(poolAllocBlock) <= blockBytes, "block header estimate too small");
+        return ::new(BlockSource::allocate(blockBytes)) poolAllocBlock();
+    }
+    template<class BlockSource>
+    static void destroy(poolAllocBlock* block) noexcept {
+        block->~poolAllocBlock();
+        BlockSource::deallocate(block, blockBytes);
+    }
+    static poolAllocBlock* ownerOf(const Pointer ptr) noexcept {//O(1)
+        return reinterpret_cast<poolAllocBlock*>(reinterpret_cast<uintptr_t>(ptr) & ~(blockBytes - 1));
     }
 
-
-
-    __declspec(noinline) Pointer allocate(const std::size_t count) throw (std::bad_alloc) {	// allocate array of _Count elements
-        if (count != 1)throw std::bad_alloc();
-        for (auto i = 0u; i < blockSize; i++) {
-            if (freelist.test(i)) {
-                freelist.set(i, false);
-                hasFree = freeListFastHasFreeCheck();
-                return reinterpret_cast<Pointer>(&data[i]);
-            }
-        }
-        throw std::bad_alloc();
-        return nullptr;
+    Pointer allocate(const std::size_t count) {	// allocate array of _Count elements. O(1)
+        if (count != 1 || !freeCount) throw std::bad_alloc();
+        auto word = countTrailingZeros(freeWords);
+        auto bit = countTrailingZeros(freelist[word]);
+        freelist[word] &= freelist[word] - 1; //clear lowest set bit
+        if (!freelist[word]) freeWords &= ~(uint64_t(1) << word);
+        --freeCount;
+        return reinterpret_cast<Pointer>(&data[word * 64 + bit]);
     }
 
-    void deallocate(const Pointer ptr) {
+    void deallocate(const Pointer ptr) {//O(1)
         if (!isInBounds(ptr)) throw std::bad_alloc(); //actually bad dealloc
-        size_t index = (reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(data.data())) / sizeof(Type);
-        freelist.set(index, true);//deallocated now
-        hasFree = true;
+        size_t index = (reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(data.data())) / sizeof(slot);
+        freelist[index / 64] |= uint64_t(1) << (index % 64);//deallocated now
+        freeWords |= uint64_t(1) << (index / 64);
+        ++freeCount;
     }
     void deallocate(const Pointer ptr, const std::size_t count) {
         if (count != 1)throw std::bad_alloc();//actually bad dealloc
         deallocate(ptr);
     }
-    __declspec(noinline) bool hasFreeElements() const noexcept {
-        return hasFree;
+    bool hasFreeElements() const noexcept {//O(1)
+        return freeCount != 0;
+    }
+    bool isEmpty() const noexcept {//O(1) nothing allocated
+        return freeCount == blockSize;
     }
     std::pair<uintptr_t, uintptr_t> getBounds() {
-        return { reinterpret_cast<uintptr_t>(data.data()), reinterpret_cast<uintptr_t>(data.data()) + blockSize };
+        return { reinterpret_cast<uintptr_t>(data.data()), reinterpret_cast<uintptr_t>(data.data() + blockSize) };
     }
     bool isInBounds(const Pointer ptr) {
         auto bounds = getBounds();
-        return bounds.first <= reinterpret_cast<uintptr_t>(ptr) && bounds.second >= reinterpret_cast<uintptr_t>(ptr);
+        return bounds.first <= reinterpret_cast<uintptr_t>(ptr) && bounds.second > reinterpret_cast<uintptr_t>(ptr);
     }
 };
 
-template<class Type>
+template<class Type, class BlockSource = heapBlockSource>
 class poolAllocator {
+public:
+    using value_type = Type;
+private:
     using Pointer = Type*;
     using BlockType = poolAllocBlock<Type>;
+    struct blockDeleter {
+        void operator()(BlockType* block) const noexcept { BlockType::template destroy<BlockSource>(block); }
+    };
 
+    std::vector<std::unique_ptr<BlockType, blockDeleter>> blocks;
+    BlockType* freeBlocks = nullptr; //partially filled blocks. Linked through poolAllocBlock::nextFree/prevFree
+    BlockType* emptyBlocks = nullptr; //completely free blocks kept warm. Linked through poolAllocBlock::nextFree
+    size_t emptyCount = 0;
+    size_t retainEmptyBlocks = 4; //more empty blocks than this are given back right away
 
-    std::vector<std::unique_ptr<BlockType>> blocks; //#TODO keep freelist of blocks that have atleast 1 free element
+    void pushFree(BlockType* block) noexcept {
+        block->prevFree = nullptr;
+        block->nextFree = freeBlocks;
+        if (freeBlocks) freeBlocks->prevFree = block;
+        freeBlocks = block;
+    }
+    void unlinkFree(BlockType* block) noexcept {
+        if (block->prevFree) block->prevFree->nextFree = block->nextFree;
+        else freeBlocks = block->nextFree;
+        if (block->nextFree) block->nextFree->prevFree = block->prevFree;
+        block->nextFree = block->prevFree = nullptr;
+    }
+    void releaseEmpty(size_t keep) noexcept {//O(1) per released block
+        while (emptyCount > keep) {
+            auto block = emptyBlocks;
+            emptyBlocks = block->nextFree;
+            --emptyCount;
+            auto index = block->blockIndex;//swap with last, then drop
+            std::swap(blocks[index], blocks.back());
+            blocks[index]->blockIndex = index;
+            blocks.pop_back();
+        }
+    }
 
 public:
+    poolAllocator() = default;
+    explicit poolAllocator(size_t retainEmpty) : retainEmptyBlocks(retainEmpty) {}
 
-
-    Pointer allocate(const std::size_t count) throw (std::bad_alloc) {	// allocate array of _Count elements
+    Pointer allocate(const std::size_t count) {	// allocate array of _Count elements. O(1)
         if (count != 1) throw std::bad_alloc();
-        for (auto& block : blocks) {
-            if (block->hasFreeElements())
-                return block->allocate(count);
+        if (!freeBlocks) {
+            BlockType* block;
+            if (emptyBlocks) {//reuse a warm block
+                block = emptyBlocks;
+                emptyBlocks = block->nextFree;
+                --emptyCount;
+            } else {//allocate new block
+                blocks.emplace_back(BlockType::template create<BlockSource>());
+                block = blocks.back().get();
+                block->blockIndex = static_cast<uint32_t>(blocks.size() - 1);
+            }
+            pushFree(block);
         }
-        //allocate new block
-        auto newBlock = blocks.emplace(blocks.end(), std::make_unique<BlockType>());
-        return (*newBlock)->allocate(count);
+        auto block = freeBlocks;
+        auto ptr = block->allocate(count);
+        if (!block->hasFreeElements()) //full now
+            unlinkFree(block);
+        return ptr;
     }
 
-    void deallocate(const Pointer ptr) {
-        for (auto& block : blocks) {
-            if (block->isInBounds(ptr))
-                return block->deallocate(ptr);
+    void deallocate(const Pointer ptr) {//O(1)
+        auto block = BlockType::ownerOf(ptr);
+        if (!block->hasFreeElements()) //was full. Has a free element again
+            pushFree(block);
+        block->deallocate(ptr);
+        if (block->isEmpty()) {
+            unlinkFree(block);
+            block->nextFree = emptyBlocks;
+            emptyBlocks = block;
+            ++emptyCount;
+            releaseEmpty(retainEmptyBlocks);
         }
     }
     void deallocate(const Pointer ptr, const std::size_t) {
         deallocate(ptr);
     }
+
+    void setRetainEmptyBlocks(size_t count) noexcept {//how many empty blocks stay allocated for reuse
+        retainEmptyBlocks = count;
+        releaseEmpty(retainEmptyBlocks);
+    }
+    void trim() {//gives back every empty block, ignoring the retain count
+        releaseEmpty(0);
+        blocks.shrink_to_fit();
+    }
+    void shrink_to_fit() {
+        trim();
+    }
+    size_t blockCount() const noexcept {
+        return blocks.size();
+    }
+    size_t emptyBlockCount() const noexcept {
+        return emptyCount;
+    }
+};
+
+/*
+Thread safe pool. All instances for one Type share one depot of poolAllocBlocks, so nodes freed on one thread are reused on others.
+Every thread caches free slots in two magazines and only touches the depot when both are empty or both are full.
+Full magazines are handed back to the depot through a lock-free stack. Taking a magazine or carving new ones out of the blocks locks the depot.
+Slots only go back to their block when a thread exits with a partially filled magazine.
+*/
+template<class Type>
+class sharedPoolAllocator {
+    using Pointer = Type*;
+    static const uint32_t magazineSize = 64;
+
+    struct freeSlot {
+        freeSlot* next; //next free slot in the same magazine
+        freeSlot* nextMagazine; //only used on the first slot of a magazine in the depot
+    };
+    static_assert(sizeof(Type) >= sizeof(freeSlot), "free slots store their links inside the element");
+
+    struct magazine {
+        freeSlot* top = nullptr;
+        uint32_t count = 0;
+
+        Pointer pop() noexcept {
+            auto slot = top;
+            top = slot->next;
+            --count;
+            return reinterpret_cast<Pointer>(slot);
+        }
+        void push(Pointer ptr) noexcept {
+            auto slot = reinterpret_cast<freeSlot*>(ptr);
+            slot->next = top;
+            top = slot;
+            ++count;
+        }
+    };
+
+    class depot {
+        std::atomic<freeSlot*> fullMagazines{ nullptr }; //pushed lock-free, popped under lock. Only one popper so no ABA
+        std::mutex lock;
+        poolAllocator<Type> pool;
+    public:
+        void put(magazine& mag) noexcept {//lock-free
+            auto head = mag.top;
+            head->nextMagazine = fullMagazines.load(std::memory_order_relaxed);
+            while (!fullMagazines.compare_exchange_weak(head->nextMagazine, head, std::memory_order_release, std::memory_order_relaxed));
+            mag = magazine();
+        }
+        void take(magazine& mag) {//Fills an empty magazine
+            std::lock_guard<std::mutex> guard(lock);
+            auto head = fullMagazines.load(std::memory_order_acquire);
+            while (head && !fullMagazines.compare_exchange_weak(head, head->nextMagazine, std::memory_order_acquire, std::memory_order_acquire));
+            if (head) {
+                mag.top = head;
+                mag.count = magazineSize;
+                return;
+            }
+            while (mag.count < magazineSize)//depot is empty. Carve a new magazine out of the blocks
+                mag.push(pool.allocate(1));
+        }
+        void trim() {
+            std::lock_guard<std::mutex> guard(lock);
+            pool.trim();
+        }
+        void release(magazine& mag) noexcept {//Partially filled magazine. Slots go back to their blocks
+            std::lock_guard<std::mutex> guard(lock);
+            while (mag.count)
+                pool.deallocate(mag.pop());
+        }
+    };
+
+    static depot& getDepot() {
+        static depot* instance = new depot(); //never destroyed. Thread caches may still flush into it during shutdown
+        return *instance;
+    }
+
+    struct threadCache {
+        magazine loaded;
+        magazine previous;
+        ~threadCache() {//previous is always either full or empty. loaded may be anything
+            if (previous.count) getDepot().put(previous);
+            if (loaded.count == magazineSize) getDepot().put(loaded);
+            else if (loaded.count) getDepot().release(loaded);
+        }
+    };
+
+    static threadCache& getCache() {
+        static thread_local threadCache cache;
+        return cache;
+    }
+
+public:
+    using value_type = Type;
+
+    sharedPoolAllocator() = default;
+    template<class Other>
+    sharedPoolAllocator(const sharedPoolAllocator<Other>&) noexcept {}
+
+    Pointer allocate(const std::size_t count) {//O(1). Locks the depot once every magazineSize allocations at most
+        if (count != 1) throw std::bad_alloc();
+        auto& cache = getCache();
+        if (!cache.loaded.count) {
+            if (cache.previous.count)
+                std::swap(cache.loaded, cache.previous);
+            else
+                getDepot().take(cache.loaded);
+        }
+        return cache.loaded.pop();
+    }
+
+    void deallocate(const Pointer ptr, const std::size_t = 1) noexcept {//O(1). Lock-free
+        auto& cache = getCache();
+        if (cache.loaded.count == magazineSize) {
+            if (cache.previous.count)
+                getDepot().put(cache.previous);
+            std::swap(cache.loaded, cache.previous);
+        }
+        cache.loaded.push(ptr);
+    }
+
+    static void trim() {//Gives back empty blocks of the depot. Slots cached in magazines keep their block alive
+        getDepot().trim();
+    }
+
+    bool operator==(const sharedPoolAllocator&) const noexcept { return true; }
+    bool operator!=(const sharedPoolAllocator&) const noexcept { return false; }
 };
 
 
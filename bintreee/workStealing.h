@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*
+Work stealing for tree traversals. Every worker keeps its pending tasks in a private deque and works depth first from the back.
+While another worker is idle it moves the front task, the one closest to the root and so the biggest, to its shared queue.
+Idle workers take from the shared queues. Splitting is lazy: a tree that is walked by one busy worker never pays for sharing.
+*/
+template<class Task>
+class workStealingPool {
+    struct alignas(64) sharedQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+public:
+    //visit(task, pending) runs for every task and may push more tasks to pending. Returns once every task is done
+    template<class Visit>
+    static void run(std::vector<Task> initial, size_t threads, Visit visit) {
+        threads = std::max<size_t>(threads, 1);
+        std::vector<sharedQueue> queues(threads);
+        std::atomic<size_t> outstanding{ initial.size() }; //tasks in shared queues plus tasks that are being worked on
+        std::atomic<size_t> idle{ 0 };
+        for (size_t i = 0; i < initial.size(); ++i)
+            queues[i % threads].tasks.push_back(std::move(initial[i]));
+
+        auto work = [&](size_t me) {
+            std::deque<Task> pending;
+            bool isIdle = false;
+            while (outstanding.load(std::memory_order_acquire)) {
+                bool found = false;
+                for (size_t k = 0; k < threads && !found; ++k) {//own queue first, then steal
+                    auto& queue = queues[(me + k) % threads];
+                    std::lock_guard<std::mutex> guard(queue.lock);
+                    if (queue.tasks.empty()) continue;
+                    pending.push_back(std::move(queue.tasks.front()));
+                    queue.tasks.pop_front();
+                    found = true;
+                }
+                if (!found) {
+                    if (!isIdle) ++idle;
+                    isIdle = true;
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (isIdle) --idle;
+                isIdle = false;
+
+                while (!pending.empty()) {
+                    if (pending.size() > 1 && idle.load(std::memory_order_relaxed)) {
+                        outstanding.fetch_add(1, std::memory_order_relaxed);
+                        std::lock_guard<std::mutex> guard(queues[me].lock);
+                        queues[me].tasks.push_back(std::move(pending.front()));
+                        pending.pop_front();
+                    }
+                    auto task = std::move(pending.back());
+                    pending.pop_back();
+                    visit(task, pending);
+                }
+                outstanding.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threads; ++i)
+            workers.emplace_back(work, i);
+        work(0);
+        for (auto& worker : workers)
+            worker.join();
+    }
+};